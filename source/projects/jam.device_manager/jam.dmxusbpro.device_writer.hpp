@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include "jam.dmxusbpro.frame_ring.hpp"
+
+#define TX_DRAIN_POLL_INTERVAL               1 // ms between checks of a transmit queue that hasn't drained yet
+
+
+// Writes messages to the non-blocking descriptor of a serial connection. What the driver doesn't take
+// at once is kept and written by resume(), so a message is never cut short and the messages after it
+// can't overtake it. Every connection owns its own writer. I/O thread only.
+class DeviceWriter {
+
+    public:
+
+        enum class Result {
+            COMPLETE, // the whole message has been written
+            BLOCKED,  // the driver's buffer is full, the rest of the message is written by resume()
+            FAILED    // write() failed with errorNumber(), the message is dropped
+        };
+
+        // Part of a message is waiting to be written
+        bool isBusy() const {
+            return this->_offset < this->_length;
+        }
+
+        // Writes 'bytes' or as much of it as the driver takes. 'byte_count' is set to the bytes written.
+        // Must not be called while isBusy().
+        Result write(int fd, const unsigned char *bytes, std::size_t size, std::size_t &byte_count) {
+            ssize_t written = _write(fd, bytes, size);
+
+            byte_count = written > 0 ? (std::size_t)written : 0;
+
+            if(written < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                this->_error_number = errno;
+                return Result::FAILED;
+            }
+
+            if(byte_count == size) {
+                return Result::COMPLETE;
+            }
+
+            this->_length = std::min<std::size_t>(size - byte_count, DEVICE_MESSAGE_MAX_SIZE);
+            this->_offset = 0;
+            memcpy(this->_bytes, bytes + byte_count, this->_length);
+            return Result::BLOCKED;
+        }
+
+        // Continues the message the driver didn't take completely. COMPLETE if there's none.
+        Result resume(int fd, std::size_t &byte_count) {
+            byte_count = 0;
+
+            if(!this->isBusy()) {
+                return Result::COMPLETE;
+            }
+
+            ssize_t written = _write(fd, this->_bytes + this->_offset, this->_length - this->_offset);
+
+            if(written < 0) {
+                if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return Result::BLOCKED;
+                }
+
+                this->_error_number = errno;
+                this->clear();
+                return Result::FAILED;
+            }
+
+            byte_count     = (std::size_t)written;
+            this->_offset += byte_count;
+            return this->isBusy() ? Result::BLOCKED : Result::COMPLETE;
+        }
+
+        void clear() {
+            this->_length = 0;
+            this->_offset = 0;
+        }
+
+        // errno of the last failed write
+        int errorNumber() const {
+            return this->_error_number;
+        }
+
+        // Bytes written to the driver that haven't been sent yet. 0 if the driver can't tell.
+        static int transmitQueued(int fd) {
+            int byte_count = 0;
+
+            if(ioctl(fd, TIOCOUTQ, &byte_count) != 0) {
+                return 0;
+            }
+
+            return byte_count;
+        }
+
+    private:
+
+        unsigned char _bytes[DEVICE_MESSAGE_MAX_SIZE];
+        std::size_t _length = 0;
+        std::size_t _offset = 0;
+        int _error_number   = 0;
+
+        static ssize_t _write(int fd, const unsigned char *bytes, std::size_t size) {
+            ssize_t written;
+
+            do {
+                written = ::write(fd, bytes, size);
+            } while(written < 0 && errno == EINTR);
+
+            return written;
+        }
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+
+// Vectorised conversion of bulk input (setrange lists, buffer~ samples, jit.matrix cells) to DMX values.
+// Values are clamped to 0 - 255 with saturating packs, 8 values at a time.
+class DmxConvert {
+
+    public:
+
+        // Clamps 'count' integers to 0 - 255
+        static void fromInts(const std::int32_t *values, unsigned char *destination, std::size_t count) {
+            std::size_t i = 0;
+
+#if defined(__SSE2__) || defined(_M_X64)
+            for(; i + 8 <= count; i += 8) {
+                __m128i low  = _mm_loadu_si128((const __m128i*)(values + i));
+                __m128i high = _mm_loadu_si128((const __m128i*)(values + i + 4));
+
+                _mm_storel_epi64((__m128i*)(destination + i), _mm_packus_epi16(_mm_packs_epi32(low, high), _mm_setzero_si128()));
+            }
+#elif defined(__ARM_NEON)
+            for(; i + 8 <= count; i += 8) {
+                int16x8_t narrowed = vcombine_s16(vqmovn_s32(vld1q_s32(values + i)), vqmovn_s32(vld1q_s32(values + i + 4)));
+
+                vst1_u8(destination + i, vqmovun_s16(narrowed));
+            }
+#endif
+
+            for(; i < count; i++) {
+                destination[i] = _clamp(values[i]);
+            }
+        }
+
+        // Multiplies 'count' floats by 'scale', rounds them and clamps them to 0 - 255
+        static void fromFloats(const float *values, unsigned char *destination, std::size_t count, float scale = 1.f) {
+            std::size_t i = 0;
+
+#if defined(__SSE2__) || defined(_M_X64)
+            __m128 scale_vector = _mm_set1_ps(scale);
+
+            for(; i + 8 <= count; i += 8) {
+                __m128i low  = _mm_cvtps_epi32(_clampFloats(_mm_mul_ps(_mm_loadu_ps(values + i), scale_vector)));
+                __m128i high = _mm_cvtps_epi32(_clampFloats(_mm_mul_ps(_mm_loadu_ps(values + i + 4), scale_vector)));
+
+                _mm_storel_epi64((__m128i*)(destination + i), _mm_packus_epi16(_mm_packs_epi32(low, high), _mm_setzero_si128()));
+            }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+            // The conversion saturates and turns NaN into 0, like the scalar loop.
+            // vcvtnq_s32_f32 is AArch64 only, 32-bit ARM uses the scalar loop.
+            for(; i + 8 <= count; i += 8) {
+                int32x4_t low      = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(values + i), scale));
+                int32x4_t high     = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(values + i + 4), scale));
+                int16x8_t narrowed = vcombine_s16(vqmovn_s32(low), vqmovn_s32(high));
+
+                vst1_u8(destination + i, vqmovun_s16(narrowed));
+            }
+#endif
+
+            for(; i < count; i++) {
+                float value = values[i] * scale;
+
+                // NaN ends up as 0
+                destination[i] = value >= 255.f ? 255 : (value > 0.f ? (unsigned char)std::nearbyint(value) : 0);
+            }
+        }
+
+    private:
+
+        static unsigned char _clamp(std::int32_t value) {
+            return value < 0 ? 0 : (value > 255 ? 255 : (unsigned char)value);
+        }
+
+#if defined(__SSE2__) || defined(_M_X64)
+        // _mm_cvtps_epi32 turns values beyond the int range and NaN into 0x80000000, which packs to 0.
+        // _mm_max_ps returns its second operand if either is NaN, so NaN ends up as 0.
+        static __m128 _clampFloats(__m128 values) {
+            return _mm_min_ps(_mm_max_ps(values, _mm_setzero_ps()), _mm_set1_ps(255.f));
+        }
+#endif
+};
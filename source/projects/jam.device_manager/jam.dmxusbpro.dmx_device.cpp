@@ -10,148 +10,99 @@ std::vector<std::string> Connector::getDeviceNames(bool verbose, bool reload) {
 
     std::vector<std::string> device_names;
 
-    if(this->m_device_paths.size() == 0 || reload) {
-        this->loadDevices();
-    }
-
-    for (auto& device_path : this->m_device_paths) {
-        size_t           start_pos = device_path.find("/dev/");
-
-        if (std::string::npos == start_pos) {
-            continue;
+    this->_devices_lock.lock();
+    this->_refreshDevices(reload);
+
+    for (auto& device : this->_devices) {
+        if (!device.is_enttec && !verbose) {
+            device_names.push_back("(" + device.name + ")");
+        } else {
+            device_names.push_back(device.name);
         }
-
-        std::string      device_name = device_path.substr(8);
-        const std::regex enttec_rexex("^usbserial-EN[0-9]+");
-
-        if (!std::regex_match(device_name, enttec_rexex) && !verbose) {
-            device_name = "(" + device_name + ")";
-        }
-
-        device_names.push_back(device_name);
     }
 
+    this->_devices_lock.unlock();
     return device_names;
 }
 
-void Connector::loadDevices() {
-    std::vector<std::string> serial_devices;
-    kern_return_t            kernResult;
-    io_iterator_t            serialPortIterator;
-
-    this->m_device_paths.clear();
-    kernResult = this->_findModems(&serialPortIterator);
+// Caller holds _devices_lock
+void Connector::_refreshDevices(bool force) {
+    static const std::regex enttec_rexex(ENTTEC_DEVICE_NAME_PATTERN);
 
-    if (KERN_SUCCESS != kernResult) {
-        goto exit;
+    // Reset the flag before enumerating, so a hotplug event during loadDevices() isn't lost
+    if (!force && this->_isHotplugWatching() && !this->_devices_stale.exchange(false, std::memory_order_acq_rel)) {
+        return;
     }
 
-    kernResult = this->_getModemPaths(serialPortIterator, serial_devices);
+    this->loadDevices();
+    this->_devices.clear();
+    this->_device_index.clear();
 
-    if (KERN_SUCCESS != kernResult) {
-        goto exit;
-    }
-
- exit:
-    this->m_device_paths = serial_devices;
-}
-
-kern_return_t Connector::_findModems(io_iterator_t *matchingServices) {
-
-    kern_return_t          kernResult = KERN_FAILURE;
-    CFMutableDictionaryRef classesToMatch;
-
-    classesToMatch = IOServiceMatching(kIOSerialBSDServiceValue);
-
-    if (classesToMatch == NULL) {
-        goto exit;
-    } else {
-        // Look for devices that claim to be modems.
-        CFDictionarySetValue(
-            classesToMatch,
-            CFSTR(kIOSerialBSDTypeKey),
-            CFSTR(kIOSerialBSDAllTypes)
-            );
-    }
+    for (auto& device_path : this->m_device_paths) {
+        std::string device_name = this->_deviceName(device_path);
 
-    // Get an iterator across all matching devices.
-    kernResult = IOServiceGetMatchingServices(kIOMasterPortDefault, classesToMatch, matchingServices);
+        if (device_name.empty() || this->_device_index.count(device_name) != 0) {
+            continue;
+        }
 
-    if (KERN_SUCCESS != kernResult) {
-        goto exit;
+        this->_device_index[device_name] = this->_devices.size();
+        this->_devices.push_back({ device_name, device_path, std::regex_match(device_name, enttec_rexex) });
     }
 
- exit:
-    return kernResult;
-}
-
-kern_return_t Connector::_getModemPaths(io_iterator_t serialPortIterator,std::vector<std::string>& path_map) {
-    io_object_t   modemService;
-    kern_return_t kernResult = KERN_FAILURE;
-    char          bsdPath[1024];
-
-    *bsdPath = '\0';
-
-    while ((modemService = IOIteratorNext(serialPortIterator))) {
-        CFTypeRef bsdPathAsCFString;
-
-        // Get the callout device's path (/dev/cu.xxxxx). The¬ callout device should almost always be
-        // used: the dialin device (/dev/options.xxxxx) would be used when monitoring a serial port for
-        // incoming calls, e.g. a fax listener.
-
-        bsdPathAsCFString = IORegistryEntryCreateCFProperty(modemService,
-                                                            CFSTR(kIOCalloutDeviceKey),
-                                                            kCFAllocatorDefault,
-                                                            0);
-
-        if (bsdPathAsCFString) {
-            Boolean           result;
-
-            // Convert the path from a CFString to a C (NUL-terminated) string for use
-            // with the POSIX open() call.
-            result = CFStringGetCString((CFStringRef)bsdPathAsCFString,
-                                        bsdPath,
-                                        1024,
-                                        kCFStringEncodingUTF8);
+    // Connections to unplugged devices are reported to their objects by the next health check
+    this->connections_lock.lock();
 
-            const std::string temp_path(bsdPath);
+    // Direct paths and ports opened through the _devicePath() fallback, e.g. a ttyUSB listed under its
+    // /dev/serial/by-id name only, aren't in the registry: their device file is checked instead.
+    for (auto& connection : this->_connections) {
+        if (!_isDirectPath(connection.first) && this->_device_index.count(connection.first) != 0) {
+            continue;
+        }
 
-            path_map.push_back(temp_path);
-            CFRelease(bsdPathAsCFString);
+        std::string device_path = _isDirectPath(connection.first) ? connection.first : this->_devicePath(connection.first);
 
-            if (result && KERN_SUCCESS != kernResult) {
-                kernResult = KERN_SUCCESS;
-            }
+        if (access(device_path.c_str(), F_OK) != 0) {
+            connection.second->setState(Connector::ConnectionState::MISSING);
         }
-
-        // Release the io_service_t now that we are done with it.
-        (void)IOObjectRelease(modemService);
     }
 
-    return kernResult;
+    this->connections_lock.unlock();
 }
 
-int  Connector::openSerialPort(const std::string port_name, const speed_t baud_rate) {
+Connector::connection_t Connector::openSerialPort(const std::string port_name, const speed_t baud_rate) {
 
     // check if device is already opened.
     if(this->isConnected(port_name)) {
-        return -2;
+        return nullptr;
     }
 
     struct termios options;
 
     int            fd = -1;
 
-    std::string    full_device_path = "/dev/cu." + port_name;
-    const char*    c_port_name      = full_device_path.c_str();
+    std::string    full_device_path;
+    connection_t   connection;
+
+    if (_isDirectPath(port_name)) {
+        full_device_path = port_name;
+    } else {
+        this->_devices_lock.lock();
+        this->_refreshDevices(false);
+
+        device_index_t::const_iterator device = this->_device_index.find(port_name);
+
+        full_device_path = device != this->_device_index.end() ? this->_devices[device->second].path : this->_devicePath(port_name);
+        this->_devices_lock.unlock();
+    }
 
-    fd = open(c_port_name, O_RDWR);
+    // Non-blocking: writes are resumed by the I/O reactor instead of stalling it while the driver's buffer is full
+    fd = open(full_device_path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
 
     if (fd < 0) {
         goto fail;
     }
 
-    ioctl(fd, TIOCGETA, &options);
+    tcgetattr(fd, &options);
 
     options.c_cflag &= ~PARENB;           // Clear parity bit, disabling parity (most common)
     options.c_cflag &= ~CSTOPB;           // Clear stop field, only one stop bit used in communication (most common)
@@ -173,73 +124,51 @@ int  Connector::openSerialPort(const std::string port_name, const speed_t baud_r
     // options.c_oflag &= ~OXTABS; // Prevent conversion of tabs to spaces (NOT PRESENT ON LINUX)
     // options.c_oflag &= ~ONOEOT; // Prevent removal of C-d chars (0x004) in output (NOT PRESENT ON LINUX)
 
-    options.c_cc[VTIME] = 1;    // Wait for up to 1s (10 deciseconds), returning as soon as any data is received.
+    options.c_cc[VTIME] = 0;    // Don't wait: reads only happen after poll() reported incoming bytes.
     options.c_cc[VMIN]  = 0;
 
-    ioctl(fd, TIOCSETA, &options);
+    tcsetattr(fd, TCSANOW, &options);
 
-    // The IOSSIOSPEED ioctl can be used to set arbitrary baud rates other than
-    // those specified by POSIX. The driver for the underlying serial hardware
-    // ultimately determines which baud rates can be used. This ioctl sets both
-    // the input and output speed.
-
-
-    if (ioctl(fd, IOSSIOSPEED, &baud_rate) == -1) {
-        printf("[WARN] ioctl(..., IOSSIOSPEED, %lu).\n", baud_rate);
+    // Pseudo-terminals have no baud rate divisor to set, a direct path may well be one
+    if (!this->_setBaudRate(fd, baud_rate) && !_isDirectPath(port_name)) {
         goto fail;
     }
 
-    // Check that speed is properly modified
+    // Store the options as the driver reports them, checkState() compares against these
     if (tcgetattr(fd, &options) == -1) {
         printf("[WARN] _modifyAttributes: tcgetattr failed\n");
         goto fail;
     }
 
-    if (cfgetispeed(&options) != baud_rate ||
-        cfgetospeed(&options) != baud_rate) {
-        printf("[WARN] _modifyAttributes: cfsetspeed failed, %lu, %lu.\n",
-               baud_rate,
-               cfgetispeed(&options));
-        goto fail;
-    }
-
-    // If successfull opened store termios options and file descriptor in maps
-    this->_addConnection(port_name, options, fd);
-    return fd;
+    // If successfull opened store termios options and file descriptor in the connection handle
+    connection = std::make_shared<SerialConnection>(port_name, fd, options);
+    this->_addConnection(connection);
+    return connection;
 
  fail:
 
-    // Opening port faild: remove termios options and file descriptor from maps
+    // Opening port faild: remove connection from map
     this->_removeConenction(port_name);
 
-    return -1;
-}
-
-int  Connector::closeSerialPort(std::string port_name) {
-    int close_success = 0;
-    int fd            = this->getFd(port_name);
-
-
-    if(fd != -1) {
-        flock(fd, LOCK_UN | LOCK_NB); // unlock file
-        close_success = close(fd);
-
-        if(close_success != -1) {
-            this->_removeConenction(port_name);
-        }
+    if (fd >= 0) {
+        close(fd);
     }
 
-    return close_success;
+    return nullptr;
 }
 
-int  Connector::getFd(std::string port_name) {
-    int fd = -1;
+int  Connector::closeSerialPort(const connection_t &connection) {
+    if(!connection) {
+        return 0;
+    }
+
+    int close_success = connection->close();
 
-    if(this->isConnected(port_name)) {
-        fd = this->_connections[port_name].fid;
+    if(close_success != -1) {
+        this->_removeConenction(connection->portName());
     }
 
-    return fd;
+    return close_success;
 }
 
 bool Connector::isConnected(std::string port_name) {
@@ -252,56 +181,96 @@ bool Connector::isConnected(std::string port_name) {
 }
 
 bool Connector::deviceExists(std::string port_name) {
-    std::vector<std::string> current_devices = this->getDeviceNames(true, true);
+    if (_isDirectPath(port_name)) {
+        struct stat device_stat;
+
+        return stat(port_name.c_str(), &device_stat) == 0 && S_ISCHR(device_stat.st_mode);
+    }
 
-    return std::find(
-        current_devices.begin(),
-        current_devices.end(),
-        port_name
-        ) != current_devices.end();
+    this->_devices_lock.lock();
+    this->_refreshDevices(false);
+
+    bool device_exists = this->_device_index.find(port_name) != this->_device_index.end();
+
+    this->_devices_lock.unlock();
+    return device_exists;
 }
 
-int  Connector::connectionState(std::string port_name) {
-    int     fd    = this->getFd(port_name);
-    termios options_stored;
+int  SerialConnection::checkState() {
     termios options_device;
 
-    this->_getSerialOptions(port_name, options_stored);
-
-    if (tcgetattr(fd, &options_device) < 0 ) {
-        return ConnectionState::MISSING;
+    if (tcgetattr(this->_fd, &options_device) < 0 ) {
+        this->setState(Connector::ConnectionState::MISSING);
+        return Connector::ConnectionState::MISSING;
     }
 
     // Check if someone else has modified the connection config
     if(
-        options_stored.c_cflag != options_device.c_cflag
-        || options_stored.c_iflag !=options_device.c_iflag
-        || options_stored.c_lflag !=options_device.c_lflag
-        || options_stored.c_cc[VTIME] !=options_device.c_cc[VTIME]
-        || options_stored.c_cc[VMIN] !=options_device.c_cc[VMIN]
-        || options_stored.c_ispeed !=options_device.c_ispeed
-        || options_stored.c_ospeed !=options_device.c_ospeed
+        this->_options.c_cflag != options_device.c_cflag
+        || this->_options.c_iflag !=options_device.c_iflag
+        || this->_options.c_lflag !=options_device.c_lflag
+        || this->_options.c_cc[VTIME] !=options_device.c_cc[VTIME]
+        || this->_options.c_cc[VMIN] !=options_device.c_cc[VMIN]
+        || this->_options.c_ispeed !=options_device.c_ispeed
+        || this->_options.c_ospeed !=options_device.c_ospeed
         ) {
-            return ConnectionState::MODOFIED;
+            this->setState(Connector::ConnectionState::MODOFIED);
+            return Connector::ConnectionState::MODOFIED;
     }
 
-    return ConnectionState::OK;
+    this->setState(Connector::ConnectionState::OK);
+    return Connector::ConnectionState::OK;
 }
 
-void Connector::_getSerialOptions(std::string port_name, termios &serial_option) {
-    if(this->isConnected(port_name)) {
-        serial_option = this->_connections[port_name].options;
+int  SerialConnection::monitor(std::chrono::steady_clock::time_point now) {
+    int interval_ms = this->_health_check_interval.load(std::memory_order_relaxed);
+
+    if(this->state() != Connector::ConnectionState::OK) {
+        return this->state();
+    }
+
+    if(interval_ms <= 0 || now - this->_last_health_check < std::chrono::milliseconds(interval_ms)) {
+        return Connector::ConnectionState::OK;
+    }
+
+    this->_last_health_check = now;
+    return this->checkState();
+}
+
+void SerialConnection::reportIoError(int error_number) {
+    switch (error_number) {
+        case EIO:
+        case ENXIO:
+        case ENODEV:
+        case EBADF:
+            this->setState(Connector::ConnectionState::MISSING);
+            return;
+
+        default:
+            // EAGAIN, EINTR and friends are transient
+            return;
     }
 }
 
-void Connector::_addConnection(const std::string port_name, const termios options, const int file_descriptor) {
-    connection_t connection {
-        options,
-        file_descriptor
-    };
+int  SerialConnection::close() {
+    int close_success = 0;
+
+    if(this->_fd != -1) {
+        flock(this->_fd, LOCK_UN | LOCK_NB); // unlock file
+        close_success = ::close(this->_fd);
+
+        if(close_success != -1) {
+            this->_fd = -1;
+            this->setState(Connector::ConnectionState::MISSING);
+        }
+    }
+
+    return close_success;
+}
 
+void Connector::_addConnection(const connection_t &connection) {
     this->connections_lock.lock();
-    this->_connections[port_name] = connection;
+    this->_connections[connection->portName()] = connection;
     this->connections_lock.unlock();
 }
 
@@ -1,28 +1,37 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
-#include <CoreFoundation/CFString.h>
-#include <CoreFoundation/CoreFoundation.h>
+#include <cstring>
 #include <errno.h> // Error integer and strerror() function
 #include <fcntl.h>
 #include <iostream>
-#include <IOKit/IOBSD.h>
-#include <IOKit/IOKitLib.h>
-#include <IOKit/serial/ioss.h>
-#include <IOKit/serial/IOSerialKeys.h>
+#include <memory>
 #include <mutex>
 #include <regex>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string>
+#include <sys/file.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <termios.h>
 #include <thread>
 #include <unistd.h>
 #include <unordered_map>
 #include <vector>
+#if defined(__APPLE__)
+#include <CoreFoundation/CFString.h>
+#include <CoreFoundation/CoreFoundation.h>
+#include <IOKit/IOBSD.h>
+#include <IOKit/IOKitLib.h>
+#include <IOKit/serial/ioss.h>
+#include <IOKit/serial/IOSerialKeys.h>
+#endif
+#include "jam.dmxusbpro.io_reactor.hpp"
 
 
 // Common definitions for jam.dmxusbpro and jam.dmxusbpro~
@@ -40,18 +49,48 @@
 #define TO_OUTLET_2                          0x01
 #define TO_OUTLET_3                          0x02
 #define TO_OUTLET_DUMPOUT                    0x03
+#define TO_MAX_CONSOLE_ERROR                 0xFD
 #define TO_MAX_CONSOLE_WARN                  0xFE
 #define TO_MAX_CONSOLE                       0xFF
 #define RESPONSE_TIMEOUT                     250
+#define DMX_MIN_CHANNELS                     24  // shortest frame allowed by DMX512
+#define DMX_SLOTS                            513 // start code and 512 channels
+#define DMX_CHANGE_BLOCK_SIZE                8   // label 9: slots per unit of the start block number
+#define DMX_CHANGE_MASK_BYTES                5   // label 9: bytes of the changed slot bit array
+#define IO_TICK_INTERVAL                     250 // ms between periodic checks of each connection
+#define IO_REACTOR_THREADS                   1   // threads serving all open connections
+#define AUDIO_IO_POLL_INTERVAL               2   // ms between reactor checks for frames pushed by the audio thread, which doesn't wake it
+#define HEALTH_CHECK_INTERVAL                1000 // default ms between termios checks of a connection
 
-class Connector {
+#if defined(__APPLE__)
+#define SERIAL_DEVICE_PREFIX                 "/dev/cu."
+#define ENTTEC_DEVICE_NAME_PATTERN           "^usbserial-EN[0-9]+"
+#elif defined(__linux__)
+#define SERIAL_DEVICE_PREFIX                 "/dev/"
+#define SERIAL_BY_ID_PREFIX                  "/dev/serial/by-id/"
+#define SERIAL_SYSFS_TTY_DIR                 "/sys/class/tty/"
+#define ENTTEC_DEVICE_NAME_PATTERN           "^usb-.*_EN[0-9]+-if[0-9]+(-port[0-9]+)?$"
+
+// Implemented in jam.dmxusbpro.serial_linux.cpp, which uses the kernel's termios2 and
+// can't share a translation unit with <termios.h>.
+bool linuxSetBaudRate(int fd, unsigned int baud_rate);
+bool linuxSetLowLatency(int fd);
+#endif
 
-    typedef struct {
-        termios options;
-        int fid;
-    } connection_t;
+class HotplugWatch;
+class SerialConnection;
 
-    typedef std::unordered_map<std::string, connection_t> connection_map_t;
+// Serial device as listed by the platform backend
+typedef struct {
+    std::string name;
+    std::string path;
+    bool        is_enttec;
+} device_info_t;
+
+class Connector {
+
+    typedef std::unordered_map<std::string, std::shared_ptr<SerialConnection> > connection_map_t;
+    typedef std::unordered_map<std::string, std::size_t> device_index_t;
 
     public:
 
@@ -61,7 +100,11 @@ class Connector {
             MODOFIED
         };
 
+        // Ref-counted handle to an open serial port. The I/O paths work on the handle only.
+        typedef std::shared_ptr<SerialConnection> connection_t;
+
         Connector(const Connector&) = delete;
+        ~Connector();
 
         static Connector & get() {
             static Connector instance;
@@ -75,20 +118,122 @@ class Connector {
         bool deviceExists(std::string port_name);
         std::vector<std::string>&getDevicePaths();
         std::vector<std::string> getDeviceNames(bool verbose, bool reload = false);
-        int openSerialPort(std::string port_name, speed_t baud_rate);
-        int closeSerialPort(std::string port_name);
-        int getFd(std::string port_name);
+
+        // Marks the device registry as outdated. Called by the hotplug watch of the platform backend,
+        // the next lookup enumerates the devices again.
+        void invalidateDevices() {
+            this->_devices_stale.store(true, std::memory_order_release);
+        }
+        connection_t openSerialPort(std::string port_name, speed_t baud_rate);
+        int closeSerialPort(const connection_t &connection);
         bool isConnected(std::string port_name);
-        int connectionState(std::string port_name);
+
+        IoReactor & reactor() {
+            return this->_reactor;
+        }
 
     private:
-        Connector() {};
+        Connector();
 
         std::vector<std::string> m_device_paths;
         connection_map_t _connections;
+        IoReactor _reactor { IO_REACTOR_THREADS };
+
+        // Device registry: the devices are only enumerated again after a hotplug event.
+        // Without a working hotplug watch every lookup enumerates, as before.
+        std::mutex _devices_lock;
+        std::vector<device_info_t> _devices;
+        device_index_t _device_index;
+        std::atomic<bool> _devices_stale { true };
+        std::unique_ptr<HotplugWatch> _hotplug_watch; // after _reactor: it is served by it
+        void _refreshDevices(bool force);
+        bool _isHotplugWatching();
+
+        // Ports given by absolute path, e.g. the pty of jam.dmxusbpro_emulator, bypass the registry
+        static bool _isDirectPath(const std::string &port_name) {
+            return !port_name.empty() && port_name[0] == '/';
+        }
+
+        // Platform backends: jam.dmxusbpro.dmx_device_mac.cpp and jam.dmxusbpro.dmx_device_linux.cpp
+        std::string _deviceName(const std::string &device_path);
+        std::string _devicePath(const std::string &port_name);
+        bool _setBaudRate(int fd, speed_t baud_rate);
+#if defined(__APPLE__)
         kern_return_t _findModems(io_iterator_t *matchingServices);
         kern_return_t _getModemPaths(io_iterator_t serialPortIterator, std::vector<std::string>& path_map);
-        void _addConnection(std::string port_name, termios options, int file_descriptor);
+#elif defined(__linux__)
+        void _getSerialByIdPaths(std::vector<std::string>& path_map, std::vector<std::string>& tty_names);
+        void _getTtyPaths(std::vector<std::string>& path_map, const std::vector<std::string>& skip_tty_names);
+        static bool _isUartPresent(const std::string &tty_name);
+#endif
+        void _addConnection(const connection_t &connection);
         void _removeConenction(std::string port_name);
-        void _getSerialOptions(std::string port_name, termios &serial_options);
+};
+
+
+// An open serial port: file descriptor, the termios options it has been configured with and its health.
+class SerialConnection {
+
+    public:
+
+        SerialConnection(const std::string &port_name, int fd, const termios &options)
+            : _port_name(port_name), _fd(fd), _options(options) {}
+
+        SerialConnection(const SerialConnection&) = delete;
+
+        ~SerialConnection() {
+            this->close();
+        }
+
+        const std::string & portName() const {
+            return this->_port_name;
+        }
+
+        int fd() const {
+            return this->_fd;
+        }
+
+        const termios & options() const {
+            return this->_options;
+        }
+
+        // Last known Connector::ConnectionState
+        int state() const {
+            return this->_state.load(std::memory_order_acquire);
+        }
+
+        void setState(int connection_state) {
+            this->_state.store(connection_state, std::memory_order_release);
+        }
+
+        // Compares the device's termios options with the ones set when opening and updates state()
+        int checkState();
+
+        // Runs checkState() when the last check is older than the health check interval, otherwise
+        // returns the state last set by a check or an I/O error. Called from the reactor tick.
+        int monitor(std::chrono::steady_clock::time_point now);
+
+        // Milliseconds between termios checks in monitor(). 0 disables them, I/O errors are still detected.
+        void setHealthCheckInterval(int interval_ms) {
+            this->_health_check_interval.store(interval_ms, std::memory_order_relaxed);
+        }
+
+        // Errors of read() or write() meaning the device is gone set state() to MISSING
+        void reportIoError(int error_number);
+
+        // read() returned 0 although poll() reported data: the device has been unplugged
+        void reportEndOfFile() {
+            this->setState(Connector::ConnectionState::MISSING);
+        }
+
+        int close();
+
+    private:
+
+        std::string _port_name;
+        int _fd;
+        termios _options;
+        std::atomic<int> _state { Connector::ConnectionState::OK };
+        std::atomic<int> _health_check_interval { HEALTH_CHECK_INTERVAL };
+        std::chrono::steady_clock::time_point _last_health_check;
 };
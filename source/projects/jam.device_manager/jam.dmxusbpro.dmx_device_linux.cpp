@@ -0,0 +1,255 @@
+#if defined(__linux__)
+
+#include <dirent.h>
+#include <limits.h>
+#include <sys/inotify.h>
+#include "jam.dmxusbpro.dmx_device.hpp"
+
+
+// Watches /dev and /dev/serial/by-id with inotify and invalidates the device registry when a tty
+// appears or disappears. The inotify descriptor is served by the Connector's I/O reactor.
+class HotplugWatch : public IoClient {
+
+    public:
+
+        explicit HotplugWatch(Connector *connector) : _connector(connector) {
+            this->_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+            if (this->_fd < 0) {
+                return;
+            }
+
+            if (inotify_add_watch(this->_fd, "/dev", IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR) < 0) {
+                close(this->_fd);
+                this->_fd = -1;
+                return;
+            }
+
+            this->_watchById();
+            this->_is_watching = true;
+            this->_connector->reactor().add(this, this->_fd);
+        }
+
+        ~HotplugWatch() {
+            if (this->_fd >= 0) {
+                this->_connector->reactor().remove(this);
+                close(this->_fd);
+            }
+        }
+
+        bool isWatching() const {
+            return this->_is_watching.load(std::memory_order_acquire);
+        }
+
+    protected:
+
+        void onIoSend(int) override {
+        }
+
+        void onIoReceive(int fd) override {
+            alignas(struct inotify_event) char buffer[4096];
+            ssize_t                            byte_count;
+            bool                               devices_changed = false;
+
+            while ((byte_count = read(fd, buffer, sizeof(buffer))) > 0) {
+                for (char *event_bytes = buffer; event_bytes < buffer + byte_count; ) {
+                    const struct inotify_event *event = (const struct inotify_event*)event_bytes;
+
+                    if (event->wd == this->_by_id_watch) {
+                        devices_changed = true;
+
+                        if (event->mask & IN_IGNORED) {
+                            this->_by_id_watch = -1;
+                        }
+                    } else if (event->len > 0 && (strncmp(event->name, "tty", 3) == 0 || strcmp(event->name, "serial") == 0)) {
+                        devices_changed = true;
+                    }
+
+                    event_bytes += sizeof(struct inotify_event) + event->len;
+                }
+            }
+
+            if (devices_changed) {
+                // /dev/serial/by-id is created along with the first USB serial device
+                if (this->_by_id_watch < 0) {
+                    this->_watchById();
+                }
+
+                this->_connector->invalidateDevices();
+            }
+        }
+
+        void onIoError(int, short) override {
+            // Fall back to enumerating on every lookup
+            this->_is_watching = false;
+            this->_connector->invalidateDevices();
+        }
+
+        void onIoTick(int, std::chrono::steady_clock::time_point) override {
+        }
+
+    private:
+
+        Connector *_connector;
+        int _fd           = -1;
+        int _by_id_watch  = -1;
+        std::atomic<bool> _is_watching { false };
+
+        void _watchById() {
+            this->_by_id_watch = inotify_add_watch(this->_fd, SERIAL_BY_ID_PREFIX, IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR);
+        }
+};
+
+
+Connector::Connector() {
+    this->_hotplug_watch.reset(new HotplugWatch(this));
+}
+
+Connector::~Connector() {
+    this->_hotplug_watch.reset();
+}
+
+bool Connector::_isHotplugWatching() {
+    return this->_hotplug_watch && this->_hotplug_watch->isWatching();
+}
+
+void Connector::loadDevices() {
+    std::vector<std::string> serial_devices;
+    std::vector<std::string> listed_tty_names;
+
+    this->m_device_paths.clear();
+
+    // USB adapters under their stable names first, e.g. usb-ENTTEC_DMX_USB_PRO_EN123456-if00-port0
+    this->_getSerialByIdPaths(serial_devices, listed_tty_names);
+
+    // Remaining ports: adapters without a serial number and on-board UARTs
+    this->_getTtyPaths(serial_devices, listed_tty_names);
+
+    this->m_device_paths = serial_devices;
+}
+
+void Connector::_getSerialByIdPaths(std::vector<std::string>& path_map, std::vector<std::string>& tty_names) {
+    DIR           *by_id_dir = opendir(SERIAL_BY_ID_PREFIX);
+    struct dirent *entry;
+    char          tty_path[PATH_MAX];
+
+    if (by_id_dir == nullptr) {
+        return;
+    }
+
+    while ((entry = readdir(by_id_dir)) != nullptr) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+
+        std::string link_path = std::string(SERIAL_BY_ID_PREFIX) + entry->d_name;
+
+        // The links point to ../../ttyUSBx. Dangling links are left over by an unplugged device.
+        if (realpath(link_path.c_str(), tty_path) == nullptr) {
+            continue;
+        }
+
+        tty_names.push_back(std::string(basename(tty_path)));
+        path_map.push_back(link_path);
+    }
+
+    closedir(by_id_dir);
+    std::sort(path_map.begin(), path_map.end());
+}
+
+void Connector::_getTtyPaths(std::vector<std::string>& path_map, const std::vector<std::string>& skip_tty_names) {
+    DIR           *tty_dir = opendir(SERIAL_SYSFS_TTY_DIR);
+    struct dirent *entry;
+    char          driver_path[PATH_MAX];
+    std::size_t   first_tty = path_map.size();
+
+    if (tty_dir == nullptr) {
+        return;
+    }
+
+    while ((entry = readdir(tty_dir)) != nullptr) {
+        std::string tty_name = entry->d_name;
+
+        if (tty_name[0] == '.' || std::find(skip_tty_names.begin(), skip_tty_names.end(), tty_name) != skip_tty_names.end()) {
+            continue;
+        }
+
+        // Virtual consoles and pseudo-terminals have no device driver
+        std::string driver_link = std::string(SERIAL_SYSFS_TTY_DIR) + tty_name + "/device/driver";
+
+        if (realpath(driver_link.c_str(), driver_path) == nullptr) {
+            continue;
+        }
+
+        std::string device_path = SERIAL_DEVICE_PREFIX + tty_name;
+
+        // The 8250 driver registers ttyS0 - ttyS31 whether there's a UART or not
+        if (std::string(basename(driver_path)) == "serial8250" && !_isUartPresent(tty_name)) {
+            continue;
+        }
+
+        path_map.push_back(device_path);
+    }
+
+    closedir(tty_dir);
+    std::sort(path_map.begin() + first_tty, path_map.end());
+}
+
+// Reads the port type the driver detected from sysfs rather than opening the tty, which could block on
+// the modem lines or disturb a port in use. Type 0 is PORT_UNKNOWN: no UART answered at the address.
+bool Connector::_isUartPresent(const std::string &tty_name) {
+    std::string type_path  = std::string(SERIAL_SYSFS_TTY_DIR) + tty_name + "/type";
+    FILE        *type_file = fopen(type_path.c_str(), "r");
+    int         port_type  = 0;
+
+    if (type_file == nullptr) {
+        return false;
+    }
+
+    if (fscanf(type_file, "%d", &port_type) != 1) {
+        port_type = 0;
+    }
+
+    fclose(type_file);
+    return port_type != 0;
+}
+
+std::string Connector::_deviceName(const std::string &device_path) {
+    if (device_path.compare(0, strlen(SERIAL_BY_ID_PREFIX), SERIAL_BY_ID_PREFIX) == 0) {
+        return device_path.substr(strlen(SERIAL_BY_ID_PREFIX));
+    }
+
+    if (device_path.compare(0, strlen(SERIAL_DEVICE_PREFIX), SERIAL_DEVICE_PREFIX) == 0) {
+        return device_path.substr(strlen(SERIAL_DEVICE_PREFIX));
+    }
+
+    return "";
+}
+
+std::string Connector::_devicePath(const std::string &port_name) {
+    std::string by_id_path = SERIAL_BY_ID_PREFIX + port_name;
+
+    if (access(by_id_path.c_str(), F_OK) == 0) {
+        return by_id_path;
+    }
+
+    return SERIAL_DEVICE_PREFIX + port_name;
+}
+
+bool Connector::_setBaudRate(int fd, speed_t baud_rate) {
+    // termios2 with BOTHER sets arbitrary baud rates, the driver picks the closest divisor
+    if (!linuxSetBaudRate(fd, (unsigned int)baud_rate)) {
+        printf("[WARN] ioctl(..., TCSETS2, %u).\n", (unsigned int)baud_rate);
+        return false;
+    }
+
+    // FTDI based adapters like the DMX USB Pro otherwise hold back incoming bytes for up to 16 ms.
+    // Not every driver supports it, so failing is no reason to give up on the port.
+    if (!linuxSetLowLatency(fd)) {
+        printf("[WARN] ioctl(..., TIOCSSERIAL, ASYNC_LOW_LATENCY) not supported.\n");
+    }
+
+    return true;
+}
+
+#endif
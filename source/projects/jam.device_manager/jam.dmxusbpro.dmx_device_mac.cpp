@@ -0,0 +1,245 @@
+#if defined(__APPLE__)
+
+#include <dispatch/dispatch.h>
+#include "jam.dmxusbpro.dmx_device.hpp"
+
+
+// Invalidates the device registry when IOKit publishes or terminates a serial device.
+// Notifications are delivered on a private dispatch queue.
+class HotplugWatch {
+
+    public:
+
+        explicit HotplugWatch(Connector *connector) : _connector(connector) {
+            const char *notification_types[] = { kIOFirstMatchNotification, kIOTerminatedNotification };
+
+            this->_notification_port = IONotificationPortCreate(kIOMasterPortDefault);
+
+            if (this->_notification_port == NULL) {
+                return;
+            }
+
+            this->_queue = dispatch_queue_create("jam.dmxusbpro.hotplug", DISPATCH_QUEUE_SERIAL);
+            IONotificationPortSetDispatchQueue(this->_notification_port, this->_queue);
+
+            for (const char *notification_type : notification_types) {
+                io_iterator_t iterator;
+
+                // IOServiceAddMatchingNotification consumes the dictionary
+                kern_return_t kernResult = IOServiceAddMatchingNotification(
+                    this->_notification_port,
+                    notification_type,
+                    IOServiceMatching(kIOSerialBSDServiceValue),
+                    &HotplugWatch::_onDevicesChanged,
+                    this,
+                    &iterator
+                    );
+
+                if (KERN_SUCCESS != kernResult) {
+                    return;
+                }
+
+                // The notification is armed once the iterator has been emptied
+                this->_iterators.push_back(iterator);
+                this->_drain(iterator);
+            }
+
+            this->_is_watching = true;
+        }
+
+        ~HotplugWatch() {
+            if (this->_notification_port != NULL) {
+                IONotificationPortDestroy(this->_notification_port);
+            }
+
+            for (io_iterator_t iterator : this->_iterators) {
+                (void)IOObjectRelease(iterator);
+            }
+
+            if (this->_queue != NULL) {
+                // Wait for a running notification before releasing the queue
+                dispatch_sync_f(this->_queue, NULL, [](void *context) {});
+                dispatch_release(this->_queue);
+            }
+        }
+
+        bool isWatching() const {
+            return this->_is_watching;
+        }
+
+    private:
+
+        Connector *_connector;
+        IONotificationPortRef _notification_port = NULL;
+        dispatch_queue_t _queue = NULL;
+        std::vector<io_iterator_t> _iterators;
+        bool _is_watching = false;
+
+        static void _onDevicesChanged(void *refcon, io_iterator_t iterator) {
+            HotplugWatch *watch = (HotplugWatch*)refcon;
+
+            watch->_drain(iterator);
+            watch->_connector->invalidateDevices();
+        }
+
+        void _drain(io_iterator_t iterator) {
+            io_object_t service;
+
+            while ((service = IOIteratorNext(iterator))) {
+                (void)IOObjectRelease(service);
+            }
+        }
+};
+
+
+Connector::Connector() {
+    this->_hotplug_watch.reset(new HotplugWatch(this));
+}
+
+Connector::~Connector() {
+    this->_hotplug_watch.reset();
+}
+
+bool Connector::_isHotplugWatching() {
+    return this->_hotplug_watch && this->_hotplug_watch->isWatching();
+}
+
+void Connector::loadDevices() {
+    std::vector<std::string> serial_devices;
+    kern_return_t            kernResult;
+    io_iterator_t            serialPortIterator;
+
+    this->m_device_paths.clear();
+    kernResult = this->_findModems(&serialPortIterator);
+
+    if (KERN_SUCCESS != kernResult) {
+        goto exit;
+    }
+
+    kernResult = this->_getModemPaths(serialPortIterator, serial_devices);
+
+    if (KERN_SUCCESS != kernResult) {
+        goto exit;
+    }
+
+ exit:
+    this->m_device_paths = serial_devices;
+}
+
+kern_return_t Connector::_findModems(io_iterator_t *matchingServices) {
+
+    kern_return_t          kernResult = KERN_FAILURE;
+    CFMutableDictionaryRef classesToMatch;
+
+    classesToMatch = IOServiceMatching(kIOSerialBSDServiceValue);
+
+    if (classesToMatch == NULL) {
+        goto exit;
+    } else {
+        // Look for devices that claim to be modems.
+        CFDictionarySetValue(
+            classesToMatch,
+            CFSTR(kIOSerialBSDTypeKey),
+            CFSTR(kIOSerialBSDAllTypes)
+            );
+    }
+
+    // Get an iterator across all matching devices.
+    kernResult = IOServiceGetMatchingServices(kIOMasterPortDefault, classesToMatch, matchingServices);
+
+    if (KERN_SUCCESS != kernResult) {
+        goto exit;
+    }
+
+ exit:
+    return kernResult;
+}
+
+kern_return_t Connector::_getModemPaths(io_iterator_t serialPortIterator,std::vector<std::string>& path_map) {
+    io_object_t   modemService;
+    kern_return_t kernResult = KERN_FAILURE;
+    char          bsdPath[1024];
+
+    *bsdPath = '\0';
+
+    while ((modemService = IOIteratorNext(serialPortIterator))) {
+        CFTypeRef bsdPathAsCFString;
+
+        // Get the callout device's path (/dev/cu.xxxxx). The¬ callout device should almost always be
+        // used: the dialin device (/dev/options.xxxxx) would be used when monitoring a serial port for
+        // incoming calls, e.g. a fax listener.
+
+        bsdPathAsCFString = IORegistryEntryCreateCFProperty(modemService,
+                                                            CFSTR(kIOCalloutDeviceKey),
+                                                            kCFAllocatorDefault,
+                                                            0);
+
+        if (bsdPathAsCFString) {
+            Boolean           result;
+
+            // Convert the path from a CFString to a C (NUL-terminated) string for use
+            // with the POSIX open() call.
+            result = CFStringGetCString((CFStringRef)bsdPathAsCFString,
+                                        bsdPath,
+                                        1024,
+                                        kCFStringEncodingUTF8);
+
+            const std::string temp_path(bsdPath);
+
+            path_map.push_back(temp_path);
+            CFRelease(bsdPathAsCFString);
+
+            if (result && KERN_SUCCESS != kernResult) {
+                kernResult = KERN_SUCCESS;
+            }
+        }
+
+        // Release the io_service_t now that we are done with it.
+        (void)IOObjectRelease(modemService);
+    }
+
+    return kernResult;
+}
+
+std::string Connector::_deviceName(const std::string &device_path) {
+    if (device_path.compare(0, strlen(SERIAL_DEVICE_PREFIX), SERIAL_DEVICE_PREFIX) != 0) {
+        return "";
+    }
+
+    return device_path.substr(strlen(SERIAL_DEVICE_PREFIX));
+}
+
+std::string Connector::_devicePath(const std::string &port_name) {
+    return SERIAL_DEVICE_PREFIX + port_name;
+}
+
+bool Connector::_setBaudRate(int fd, speed_t baud_rate) {
+    termios options;
+
+    // The IOSSIOSPEED ioctl can be used to set arbitrary baud rates other than
+    // those specified by POSIX. The driver for the underlying serial hardware
+    // ultimately determines which baud rates can be used. This ioctl sets both
+    // the input and output speed.
+    if (ioctl(fd, IOSSIOSPEED, &baud_rate) == -1) {
+        printf("[WARN] ioctl(..., IOSSIOSPEED, %lu).\n", (unsigned long)baud_rate);
+        return false;
+    }
+
+    // Check that speed is properly modified
+    if (tcgetattr(fd, &options) == -1) {
+        printf("[WARN] _modifyAttributes: tcgetattr failed\n");
+        return false;
+    }
+
+    if (cfgetispeed(&options) != baud_rate ||
+        cfgetospeed(&options) != baud_rate) {
+        printf("[WARN] _modifyAttributes: cfsetspeed failed, %lu, %lu.\n",
+               (unsigned long)baud_rate,
+               (unsigned long)cfgetispeed(&options));
+        return false;
+    }
+
+    return true;
+}
+
+#endif
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+
+// Vectorised comparison of two DMX universes. Used for the 'delta' output format, where a received
+// frame usually differs from the previous one in a handful of channels only.
+// Blocks of 32 (AVX2) or 16 (SSE2, AArch64 NEON) bytes are compared at once; only blocks holding a change
+// are looked at byte by byte.
+class DmxDiff {
+
+    public:
+
+#if defined(__AVX2__)
+        static constexpr std::size_t block_size = 32;
+#else
+        static constexpr std::size_t block_size = 16;
+#endif
+
+        // Calls on_change(index, value) in ascending order for every byte of 'current' that differs
+        // from 'previous' and updates 'previous'. Returns the number of changed bytes.
+        // CALLBACK: void(std::size_t index, unsigned char value)
+        template<typename CALLBACK>
+        static std::size_t apply(const unsigned char *current, unsigned char *previous, std::size_t size, CALLBACK on_change) {
+            std::size_t change_count = 0;
+            std::size_t i            = 0;
+
+            for(; i + block_size <= size; i += block_size) {
+                std::uint32_t changed_mask = _changedMask(current + i, previous + i);
+
+                while(changed_mask != 0) {
+                    std::size_t index = i + (std::size_t)_lowestBit(changed_mask);
+
+                    changed_mask &= changed_mask - 1;
+                    previous[index] = current[index];
+                    on_change(index, current[index]);
+                    change_count++;
+                }
+            }
+
+            for(; i < size; i++) {
+                if(current[i] != previous[i]) {
+                    previous[i] = current[i];
+                    on_change(i, current[i]);
+                    change_count++;
+                }
+            }
+
+            return change_count;
+        }
+
+    private:
+
+        static int _lowestBit(std::uint32_t mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+            unsigned long index;
+
+            _BitScanForward(&index, mask);
+            return (int)index;
+#else
+            return __builtin_ctz(mask);
+#endif
+        }
+
+        // Bit n is set if byte n of the block differs
+        static std::uint32_t _changedMask(const unsigned char *current, const unsigned char *previous) {
+#if defined(__AVX2__)
+            __m256i current_block  = _mm256_loadu_si256((const __m256i*)current);
+            __m256i previous_block = _mm256_loadu_si256((const __m256i*)previous);
+
+            return ~(std::uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(current_block, previous_block));
+#elif defined(__SSE2__) || defined(_M_X64)
+            __m128i current_block  = _mm_loadu_si128((const __m128i*)current);
+            __m128i previous_block = _mm_loadu_si128((const __m128i*)previous);
+
+            return ~(std::uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(current_block, previous_block)) & 0xFFFF;
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+            // No movemask on NEON: narrow the comparison to 4 bits per byte and skip unchanged blocks
+            uint8x16_t differs   = vmvnq_u8(vceqq_u8(vld1q_u8(current), vld1q_u8(previous)));
+            uint64_t   nibbles   = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(differs), 4)), 0);
+            std::uint32_t mask   = 0;
+
+            for(; nibbles != 0; nibbles &= nibbles - 1) {
+                mask |= 1u << (__builtin_ctzll(nibbles) / 4);
+            }
+
+            return mask;
+#else
+            std::uint64_t current_words[2];
+            std::uint64_t previous_words[2];
+            std::uint32_t mask = 0;
+
+            memcpy(current_words, current, 16);
+            memcpy(previous_words, previous, 16);
+
+            if(current_words[0] == previous_words[0] && current_words[1] == previous_words[1]) {
+                return 0;
+            }
+
+            for(int i = 0; i < 16; i++) {
+                mask |= (std::uint32_t)(current[i] != previous[i]) << i;
+            }
+
+            return mask;
+#endif
+        }
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "jam.dmxusbpro.dmx_device.hpp"
+
+
+// Preformatted 'Send DMX Packet' message for up to CHANNELS DMX channels:
+// [start, label, length lsb, length msb, DMX start code, ...channels..., end]
+// Header and end byte are computed at compile time for a full frame. A frame can carry fewer
+// channels, down to the DMX minimum of DMX_MIN_CHANNELS, which shortens the time a frame takes on
+// the wire. Updating a frame only touches the channel bytes, plus the length and end byte when the
+// channel count changes, and the whole frame can be passed to write() as it is.
+template<std::size_t CHANNELS>
+class DmxFrame {
+
+    static_assert(CHANNELS >= 1 && CHANNELS <= 512, "DMX frames carry 1 to 512 channels");
+
+    typedef std::array<unsigned char, CHANNELS + 6> bytes_t;
+
+    public:
+
+        static constexpr std::size_t max_channel_count = CHANNELS;
+        static constexpr std::size_t min_channel_count = CHANNELS < DMX_MIN_CHANNELS ? CHANNELS : DMX_MIN_CHANNELS;
+        static constexpr std::size_t header_size       = 5;
+        static constexpr std::size_t overhead_size     = 6; // header and end byte
+        static constexpr std::size_t max_frame_size    = CHANNELS + overhead_size;
+
+        constexpr DmxFrame() : _bytes(_preformat()) {}
+
+        // Channel count actually sent for a request of 'channel_count' channels
+        static constexpr std::size_t clampChannelCount(std::size_t channel_count) {
+            return channel_count < min_channel_count ? min_channel_count : (channel_count > CHANNELS ? CHANNELS : channel_count);
+        }
+
+        unsigned char* payload() {
+            return &this->_bytes[header_size];
+        }
+
+        const unsigned char* data() const {
+            return this->_bytes.data();
+        }
+
+        std::size_t channelCount() const {
+            return this->_channel_count;
+        }
+
+        std::size_t size() const {
+            return this->_channel_count + overhead_size;
+        }
+
+        // Copies the first 'channel_count' channels of 'universe' into the frame
+        void setChannels(const unsigned char *universe, std::size_t channel_count = CHANNELS) {
+            channel_count = clampChannelCount(channel_count);
+
+            if(channel_count != this->_channel_count) {
+                this->_setLength(this->_bytes.data(), channel_count);
+                this->_channel_count = channel_count;
+            }
+
+            memcpy(this->payload(), universe, channel_count);
+        }
+
+        // Encodes a complete frame of 'channel_count' channels into 'destination', which must hold
+        // at least max_frame_size bytes. Returns the frame size.
+        static std::size_t encode(unsigned char *destination, const unsigned char *universe, std::size_t channel_count = CHANNELS) {
+            channel_count = clampChannelCount(channel_count);
+
+            memcpy(destination, _header.data(), header_size);
+
+            if(channel_count != CHANNELS) {
+                _setLength(destination, channel_count);
+            }
+
+            memcpy(destination + header_size, universe, channel_count);
+            destination[channel_count + header_size] = MSG_END_CONDITION;
+            return channel_count + overhead_size;
+        }
+
+    private:
+
+        static constexpr std::uint16_t _data_byte_count = CHANNELS + 1; // channels plus DMX start code
+
+        static constexpr std::array<unsigned char, header_size> _header {
+            MSG_START_CONDITION,
+            MSG_LABEL_SEND_DMX_PACKET,
+            (unsigned char)(_data_byte_count & 0x00FF),
+            (unsigned char)((_data_byte_count & 0xFF00) >> 8),
+            0x00 // Start Code: USITT Default Null Start Code for Dimmers per DMX512 & DMX512/1990
+        };
+
+        static constexpr bytes_t _preformat() {
+            bytes_t bytes {};
+
+            for(std::size_t i = 0; i < header_size; i++) {
+                bytes[i] = _header[i];
+            }
+
+            bytes[max_frame_size - 1] = MSG_END_CONDITION;
+            return bytes;
+        }
+
+        // Writes the length bytes and the end byte for 'channel_count' channels
+        static void _setLength(unsigned char *frame, std::size_t channel_count) {
+            std::uint16_t data_byte_count = (std::uint16_t)(channel_count + 1);
+
+            frame[2]                           = (unsigned char)(data_byte_count & 0x00FF);
+            frame[3]                           = (unsigned char)((data_byte_count & 0xFF00) >> 8);
+            frame[channel_count + header_size] = MSG_END_CONDITION;
+        }
+
+        bytes_t _bytes;
+        std::size_t _channel_count = CHANNELS;
+};
+
+
+// Frame covering the full DMX universe
+typedef DmxFrame<512> dmx_frame_t;
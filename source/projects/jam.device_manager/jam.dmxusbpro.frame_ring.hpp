@@ -0,0 +1,188 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+
+// Largest message sent to the device: start, label, 2 length bytes, start code, 512 channels, end
+#define DEVICE_MESSAGE_MAX_SIZE              518
+
+typedef struct {
+    std::chrono::steady_clock::time_point enqueued_at;
+    std::uint16_t length;
+    unsigned char bytes[DEVICE_MESSAGE_MAX_SIZE];
+} device_message_t;
+
+// Scheduled messages: the longest 'latency' of 1000 ms holds 100 frames pushed every 10 ms, the shortest
+// 'push' interval, rounded up to a power of two
+#define SCHEDULED_MESSAGE_CAPACITY           128
+
+// Message to be written to the device at 'release_at', see jam.dmxusbpro~'s 'latency' attribute
+typedef struct {
+    std::chrono::steady_clock::time_point enqueued_at;
+    std::chrono::steady_clock::time_point release_at;
+    std::uint16_t length;
+    unsigned char bytes[DEVICE_MESSAGE_MAX_SIZE];
+} scheduled_message_t;
+
+// Largest DMX message received from the device: start, label, 2 length bytes, status, start code, 512 channels, end
+#define DEVICE_INPUT_MAX_SIZE                519
+
+typedef struct {
+    std::uint16_t length;
+    unsigned char bytes[DEVICE_INPUT_MAX_SIZE];
+} device_input_t;
+
+
+// Bounded lock-free queue for several producers and one consumer, used to hand messages from the
+// Max and audio threads to the send thread of jam.dmxusbpro and jam.dmxusbpro~.
+// Every slot carries a sequence number telling producers and the consumer whose turn it is
+// (D. Vyukov's bounded queue), so pushing and popping cost a few atomic operations and never allocate.
+// When the queue is full the item is dropped and counted.
+template<typename T, std::size_t CAPACITY>
+class MpscRing {
+
+    static_assert(CAPACITY >= 2 && (CAPACITY & (CAPACITY - 1)) == 0, "MpscRing capacity must be a power of two");
+
+    typedef struct {
+        std::atomic<std::size_t> sequence;
+        T item;
+    } slot_t;
+
+    public:
+
+        MpscRing() {
+            for(std::size_t i = 0; i < CAPACITY; i++) {
+                this->_slots[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        MpscRing(const MpscRing&) = delete;
+
+        // Claims a slot and lets 'fill' write the item in place. Safe to call from several threads.
+        template<typename FILL>
+        bool tryPush(FILL fill) {
+            std::size_t position = this->_enqueue_position.load(std::memory_order_relaxed);
+            slot_t      *slot;
+
+            for(;;) {
+                slot = &this->_slots[position & (CAPACITY - 1)];
+
+                std::size_t    sequence = slot->sequence.load(std::memory_order_acquire);
+                std::ptrdiff_t distance = (std::ptrdiff_t)sequence - (std::ptrdiff_t)position;
+
+                if(distance == 0) {
+                    if(this->_enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if(distance < 0) {
+                    this->_overflow_count.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                } else {
+                    position = this->_enqueue_position.load(std::memory_order_relaxed);
+                }
+            }
+
+            fill(slot->item);
+            slot->sequence.store(position + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool tryPush(const T &item) {
+            return this->tryPush([&item](T &slot_item) {
+                slot_item = item;
+            });
+        }
+
+        // Oldest item or nullptr if the queue is empty. Consumer thread only.
+        // The item stays valid until pop() is called.
+        T* front() {
+            std::size_t position = this->_dequeue_position.load(std::memory_order_relaxed);
+            slot_t      &slot    = this->_slots[position & (CAPACITY - 1)];
+
+            if(slot.sequence.load(std::memory_order_acquire) != position + 1) {
+                return nullptr;
+            }
+
+            return &slot.item;
+        }
+
+        // Releases the item returned by front(). Consumer thread only.
+        void pop() {
+            std::size_t position = this->_dequeue_position.load(std::memory_order_relaxed);
+
+            this->_slots[position & (CAPACITY - 1)].sequence.store(position + CAPACITY, std::memory_order_release);
+            this->_dequeue_position.store(position + 1, std::memory_order_relaxed);
+        }
+
+        // Drops all queued items. Consumer thread only.
+        void clear() {
+            while(this->front() != nullptr) {
+                this->pop();
+            }
+        }
+
+        // Number of queued items. Exact only when no producer is pushing concurrently.
+        std::size_t size() const {
+            std::size_t enqueued = this->_enqueue_position.load(std::memory_order_relaxed);
+            std::size_t dequeued = this->_dequeue_position.load(std::memory_order_relaxed);
+
+            return enqueued > dequeued ? enqueued - dequeued : 0;
+        }
+
+        std::size_t capacity() const {
+            return CAPACITY;
+        }
+
+        std::uint64_t overflowCount() const {
+            return this->_overflow_count.load(std::memory_order_relaxed);
+        }
+
+    private:
+
+        // Producer and consumer positions live on separate cache lines
+        alignas(64) std::atomic<std::size_t> _enqueue_position { 0 };
+        alignas(64) std::atomic<std::size_t> _dequeue_position { 0 };
+        alignas(64) std::atomic<std::uint64_t> _overflow_count { 0 };
+        slot_t _slots[CAPACITY];
+};
+
+
+// Queue of messages waiting to be written to the device
+typedef MpscRing<device_message_t, 64> device_message_queue_t;
+
+
+inline bool enqueDeviceMessage(device_message_queue_t &queue, const unsigned char *bytes, std::size_t length) {
+    if(length > DEVICE_MESSAGE_MAX_SIZE) {
+        return false;
+    }
+
+    return queue.tryPush([bytes, length](device_message_t &message) {
+        message.enqueued_at = std::chrono::steady_clock::now();
+        message.length      = (std::uint16_t)length;
+        memcpy(message.bytes, bytes, length);
+    });
+}
+
+
+// DMX frames waiting for their release time, ordered by it
+typedef MpscRing<scheduled_message_t, SCHEDULED_MESSAGE_CAPACITY> scheduled_message_queue_t;
+
+
+// DMX received by the I/O thread, waiting to be decoded on the Max thread
+typedef MpscRing<device_input_t, 32> device_input_queue_t;
+
+
+inline bool enqueDeviceInput(device_input_queue_t &queue, const unsigned char *bytes, std::size_t length) {
+    if(length > DEVICE_INPUT_MAX_SIZE) {
+        return false;
+    }
+
+    return queue.tryPush([bytes, length](device_input_t &input) {
+        input.length = (std::uint16_t)length;
+        memcpy(input.bytes, bytes, length);
+    });
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include "jam.dmxusbpro.dmx_frame.hpp"
+
+
+// Single slot holding the most recent DMX frame for jam.dmxusbpro and jam.dmxusbpro~.
+// Storing a universe replaces any frame that has not been taken by the send thread yet,
+// so the device always receives the newest universe instead of a backlog of old ones.
+// Wait-free triple buffer: three preformatted frames rotate between the producer, the pending slot
+// and the send thread. Handing over a frame is a single atomic exchange of the pending frame's index,
+// so store() can be called from the audio thread. One producer and one consumer at a time.
+template<typename FRAME>
+class LatestFrameSlot {
+
+    static constexpr std::uint8_t _index_mask = 0x03;
+    static constexpr std::uint8_t _fresh_flag = 0x04; // the pending frame hasn't been taken yet
+
+    public:
+
+        LatestFrameSlot(const LatestFrameSlot&) = delete;
+
+        LatestFrameSlot() {}
+
+        // Returns true if a frame that hadn't been taken yet has been replaced
+        bool store(const unsigned char *universe, std::size_t channel_count, std::chrono::steady_clock::time_point stored_at = {}) {
+            this->_frames[this->_back].setChannels(universe, channel_count);
+            this->_stored_at[this->_back] = stored_at;
+
+            std::uint8_t previous = this->_pending.exchange(this->_back | _fresh_flag, std::memory_order_acq_rel);
+
+            this->_back = previous & _index_mask;
+            return (previous & _fresh_flag) != 0;
+        }
+
+        // Latest stored frame or nullptr if nothing new has been stored since the last call.
+        // The frame stays valid until the next call. Send thread only.
+        const FRAME* take() {
+            if(!this->pending()) {
+                return nullptr;
+            }
+
+            std::uint8_t previous = this->_pending.exchange(this->_front, std::memory_order_acq_rel);
+
+            this->_front = previous & _index_mask;
+            return &this->_frames[this->_front];
+        }
+
+        // A frame has been stored since the last take()
+        bool pending() const {
+            return (this->_pending.load(std::memory_order_acquire) & _fresh_flag) != 0;
+        }
+
+        // 'stored_at' passed to store() for the frame returned by the last take(). Send thread only.
+        std::chrono::steady_clock::time_point storedAt() const {
+            return this->_stored_at[this->_front];
+        }
+
+        void clear() {
+            this->_pending.fetch_and((std::uint8_t)~_fresh_flag, std::memory_order_acq_rel);
+        }
+
+    private:
+
+        FRAME _frames[3];
+        std::chrono::steady_clock::time_point _stored_at[3];
+        std::uint8_t _back  = 0; // producer only
+        std::uint8_t _front = 2; // consumer only
+        std::atomic<std::uint8_t> _pending { 1 };
+};
@@ -0,0 +1,256 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <errno.h>
+#include <poll.h>
+#include <thread>
+#include "jam.dmxusbpro.dmx_device.hpp"
+#include "jam.dmxusbpro.io_reactor.hpp"
+
+
+// One reactor thread and the clients it serves
+class IoReactor::Loop {
+
+    typedef std::chrono::steady_clock clock_t;
+
+    public:
+
+        ~Loop() {
+            if(this->_thread.joinable()) {
+                this->_running = false;
+                this->_wakeup.notify();
+                this->_thread.join();
+            }
+        }
+
+        void add(IoClient *client, int fd) {
+            this->_clients_lock.lock();
+
+            client->_io_fd     = fd;
+            client->_io_failed = false;
+            client->_io_loop   = this;
+            client->_io_wakeup.store(&this->_wakeup, std::memory_order_release);
+            this->_clients.push_back(client);
+            this->_clients_changed = true;
+
+            if(!this->_thread.joinable()) {
+                this->_running = true;
+                this->_thread  = std::thread([this]() {
+                    this->_run();
+                });
+            }
+
+            this->_clients_lock.unlock();
+            this->_wakeup.notify();
+        }
+
+        void remove(IoClient *client) {
+            // Waits for a running dispatch to finish, the lock is held while calling back clients
+            this->_clients_lock.lock();
+
+            client->_io_send_at.store(0, std::memory_order_release);
+
+            this->_clients.erase(std::remove(this->_clients.begin(), this->_clients.end(), client), this->_clients.end());
+            this->_clients_changed = true;
+            client->_io_wakeup.store(nullptr, std::memory_order_release);
+            client->_io_loop   = nullptr;
+            client->_io_fd     = -1;
+
+            this->_clients_lock.unlock();
+            this->_wakeup.notify();
+        }
+
+        std::size_t clientCount() {
+            this->_clients_lock.lock();
+
+            std::size_t client_count = this->_clients.size();
+
+            this->_clients_lock.unlock();
+            return client_count;
+        }
+
+    private:
+
+        std::thread _thread;
+        std::atomic<bool> _running { false };
+        IoWakeup _wakeup;
+        std::mutex _clients_lock;
+        std::vector<IoClient*> _clients;
+        bool _clients_changed = false;
+
+        void _run() {
+            std::vector<struct pollfd> poll_fds;
+            std::vector<IoClient*>     polled_clients;
+            clock_t::time_point        next_tick   = clock_t::now() + std::chrono::milliseconds(IO_TICK_INTERVAL);
+            bool                       poll_failed = false;
+
+            while(this->_running) {
+                this->_clients_lock.lock();
+
+                if(this->_clients_changed) {
+                    polled_clients.clear();
+
+                    for(IoClient *client : this->_clients) {
+                        if(!client->_io_failed) {
+                            polled_clients.push_back(client);
+                        }
+                    }
+
+                    this->_clients_changed = false;
+                }
+
+                poll_fds.resize(polled_clients.size() + 1);
+                poll_fds[0] = { this->_wakeup.fd(), POLLIN, 0 };
+
+                clock_t::time_point now     = clock_t::now();
+                clock_t::time_point wake_at = next_tick;
+
+                for(std::size_t i = 0; i < polled_clients.size(); i++) {
+                    std::int64_t              send_at       = polled_clients[i]->_io_send_at.load(std::memory_order_acquire);
+                    std::chrono::milliseconds poll_interval = polled_clients[i]->_io_poll_interval;
+
+                    poll_fds[i + 1] = { polled_clients[i]->_io_fd, POLLIN, 0 };
+
+                    // Requests made without a wakeup are only seen when poll() returns
+                    if(poll_interval.count() > 0 && now + poll_interval < wake_at) {
+                        wake_at = now + poll_interval;
+                    }
+
+                    if(send_at != 0 && clock_t::time_point(clock_t::duration(send_at)) < wake_at) {
+                        wake_at = clock_t::time_point(clock_t::duration(send_at));
+                    }
+                }
+
+                this->_clients_lock.unlock();
+
+                // poll() counts in ms: the last fraction of a millisecond before a timed send is slept
+                auto wait = wake_at - clock_t::now();
+
+                if(wait > clock_t::duration::zero() && wait < std::chrono::milliseconds(1)) {
+                    std::this_thread::sleep_until(wake_at);
+                    wait = clock_t::duration::zero();
+                }
+
+                auto wait_ms     = std::chrono::duration_cast<std::chrono::milliseconds>(wait);
+                int  ready_count = poll(poll_fds.data(), (nfds_t)poll_fds.size(), std::max(0, (int)wait_ms.count()));
+
+                // Errors like EINVAL or ENOMEM come back at once: report them once, then rebuild the
+                // descriptor list and back off for a tick instead of spinning
+                if(ready_count < 0 && errno != EINTR) {
+                    if(!poll_failed) {
+                        printf("[WARN] poll() failed: %s.\n", strerror(errno));
+                        poll_failed = true;
+                    }
+
+                    this->_clients_lock.lock();
+                    this->_clients_changed = true;
+                    this->_clients_lock.unlock();
+
+                    std::this_thread::sleep_for(std::chrono::milliseconds(IO_TICK_INTERVAL));
+                    continue;
+                }
+
+                poll_failed = false;
+
+                this->_dispatch(poll_fds, polled_clients, next_tick);
+            }
+        }
+
+        void _dispatch(const std::vector<struct pollfd> &poll_fds, const std::vector<IoClient*> &polled_clients, clock_t::time_point &next_tick) {
+            clock_t::time_point now = clock_t::now();
+
+            this->_clients_lock.lock();
+
+            if(poll_fds[0].revents & POLLIN) {
+                this->_wakeup.drain();
+            }
+
+            // Messages to the devices are written before handling incoming bytes
+            for(IoClient *client : this->_clients) {
+                if(client->_io_failed) {
+                    continue;
+                }
+
+                bool         send_due = client->_io_send_pending.exchange(false, std::memory_order_acq_rel);
+                std::int64_t send_at  = client->_io_send_at.load(std::memory_order_acquire);
+
+                // A request for an earlier time that arrives meanwhile fails the exchange and is served next round
+                if(send_at != 0 && clock_t::time_point(clock_t::duration(send_at)) <= now
+                   && client->_io_send_at.compare_exchange_strong(send_at, 0, std::memory_order_acq_rel)) {
+                    send_due = true;
+                }
+
+                if(send_due) {
+                    client->onIoSend(client->_io_fd);
+                }
+            }
+
+            // A client may have been removed since poll() started; its events are dropped
+            // and polled again after the descriptor list has been rebuilt.
+            if(!this->_clients_changed) {
+                for(std::size_t i = 0; i < polled_clients.size(); i++) {
+                    IoClient *client      = polled_clients[i];
+                    short     poll_events = poll_fds[i + 1].revents;
+
+                    if(poll_events & (POLLERR | POLLHUP | POLLNVAL)) {
+                        client->_io_failed     = true;
+                        this->_clients_changed = true;
+                        client->onIoError(client->_io_fd, poll_events);
+                    } else if(poll_events & POLLIN) {
+                        client->onIoReceive(client->_io_fd);
+                    }
+                }
+            }
+
+            if(now >= next_tick) {
+                for(IoClient *client : this->_clients) {
+                    if(!client->_io_failed) {
+                        client->onIoTick(client->_io_fd, now);
+                    }
+                }
+
+                next_tick = now + std::chrono::milliseconds(IO_TICK_INTERVAL);
+            }
+
+            this->_clients_lock.unlock();
+        }
+};
+
+
+IoReactor::IoReactor(std::size_t thread_count) {
+    for(std::size_t i = 0; i < std::max<std::size_t>(1, thread_count); i++) {
+        this->_loops.push_back(std::unique_ptr<Loop>(new Loop()));
+    }
+}
+
+IoReactor::~IoReactor() {
+    this->_loops.clear();
+}
+
+void IoReactor::add(IoClient *client, int fd) {
+    Loop        *least_busy_loop   = this->_loops[0].get();
+    std::size_t least_client_count = least_busy_loop->clientCount();
+
+    for(std::size_t i = 1; i < this->_loops.size(); i++) {
+        std::size_t client_count = this->_loops[i]->clientCount();
+
+        if(client_count < least_client_count) {
+            least_busy_loop    = this->_loops[i].get();
+            least_client_count = client_count;
+        }
+    }
+
+    least_busy_loop->add(client, fd);
+}
+
+void IoReactor::remove(IoClient *client) {
+    Loop *loop = static_cast<Loop*>(client->_io_loop);
+
+    if(loop != nullptr) {
+        loop->remove(client);
+    }
+}
+
+std::size_t IoReactor::threadCount() const {
+    return this->_loops.size();
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "jam.dmxusbpro.io_wakeup.hpp"
+
+class IoReactor;
+
+
+// Base class for objects whose serial connection is served by the IoReactor.
+// All on... callbacks run on a reactor thread. They must return quickly and must not call
+// IoReactor::remove(); hand work like closing the connection over to the Max thread instead.
+class IoClient {
+
+    friend class IoReactor;
+
+    public:
+
+        virtual ~IoClient() {}
+
+        // Asks the reactor to call onIoSend() as soon as possible. Safe to call from any thread and cheap
+        // to call repeatedly. Waking the reactor costs a syscall: with 'wake_reactor' false the request is
+        // only a store, picked up within the interval given to setIoPollInterval(). Use that on the audio thread.
+        void requestIoSend(bool wake_reactor = true) {
+            this->_io_send_pending.store(true, std::memory_order_release);
+
+            if(wake_reactor) {
+                this->_wakeReactor();
+            }
+        }
+
+        // Asks the reactor to call onIoSend() at 'send_at'. Only the earliest pending request is kept,
+        // onIoSend() has to ask again for later ones. Safe to call from any thread, 'wake_reactor' as above.
+        void requestIoSendAt(std::chrono::steady_clock::time_point send_at, bool wake_reactor = true) {
+            std::int64_t send_at_count = (std::int64_t)send_at.time_since_epoch().count();
+            std::int64_t scheduled     = this->_io_send_at.load(std::memory_order_acquire);
+
+            do {
+                if(scheduled != 0 && scheduled <= send_at_count) {
+                    return;
+                }
+            } while(!this->_io_send_at.compare_exchange_weak(scheduled, send_at_count, std::memory_order_acq_rel));
+
+            if(wake_reactor) {
+                this->_wakeReactor();
+            }
+        }
+
+    protected:
+
+        // Lets the reactor look for requests made without waking it at least every 'interval'.
+        // Call it before the client is added. 0 (default) relies on wakeups only.
+        void setIoPollInterval(std::chrono::milliseconds interval) {
+            this->_io_poll_interval = interval;
+        }
+
+        // There are messages waiting to be written to 'fd'
+        virtual void onIoSend(int fd) = 0;
+
+        // Bytes arrived on 'fd'
+        virtual void onIoReceive(int fd) = 0;
+
+        // 'fd' reported an error or hang up. The reactor stops polling it.
+        virtual void onIoError(int fd, short poll_events) = 0;
+
+        // Called every IO_TICK_INTERVAL ms for periodic work such as response timeouts
+        virtual void onIoTick(int fd, std::chrono::steady_clock::time_point now) = 0;
+
+    private:
+
+        int _io_fd = -1;
+        bool _io_failed = false;
+        std::atomic<bool> _io_send_pending { false };
+        std::atomic<std::int64_t> _io_send_at { 0 }; // steady_clock ticks of the next timed onIoSend(), 0 if none
+        std::atomic<IoWakeup*> _io_wakeup { nullptr };
+        std::chrono::milliseconds _io_poll_interval { 0 };
+        void *_io_loop = nullptr;
+
+        void _wakeReactor() {
+            IoWakeup *wakeup = this->_io_wakeup.load(std::memory_order_acquire);
+
+            if(wakeup != nullptr) {
+                wakeup->notify();
+            }
+        }
+};
+
+
+// Serves the serial connections of all jam.dmxusbpro(~) instances from a small, fixed number of threads.
+// Each thread waits in poll() on the descriptors of its clients plus a wakeup descriptor, so the
+// thread count doesn't grow with the number of open interfaces.
+class IoReactor {
+
+    class Loop;
+
+    public:
+
+        explicit IoReactor(std::size_t thread_count);
+        ~IoReactor();
+
+        IoReactor(const IoReactor&) = delete;
+
+        // Starts serving 'fd' for 'client' on the least busy thread
+        void add(IoClient *client, int fd);
+
+        // Stops serving 'client'. Blocks until no callback of 'client' is running anymore.
+        // Must not be called from a reactor callback.
+        void remove(IoClient *client);
+
+        std::size_t threadCount() const;
+
+    private:
+
+        std::vector<std::unique_ptr<Loop> > _loops;
+};
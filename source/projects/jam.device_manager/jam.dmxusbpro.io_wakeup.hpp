@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+
+
+// File descriptor to wake an I/O thread waiting in poll() as soon as there is something to send.
+// Uses an eventfd on Linux and a non-blocking pipe elsewhere. notify() only touches the
+// descriptor once until the I/O thread drains it, so committing many frames in a row costs
+// a single syscall.
+class IoWakeup {
+
+    public:
+
+        IoWakeup(const IoWakeup&) = delete;
+
+        IoWakeup() {
+#if defined(__linux__)
+            this->_read_fd  = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            this->_write_fd = this->_read_fd;
+#else
+            int pipe_fds[2];
+
+            if(pipe(pipe_fds) == 0) {
+                this->_read_fd  = pipe_fds[0];
+                this->_write_fd = pipe_fds[1];
+
+                for(int fd : pipe_fds) {
+                    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                    fcntl(fd, F_SETFD, FD_CLOEXEC);
+                }
+            }
+#endif
+        }
+
+        ~IoWakeup() {
+            if(this->_read_fd != -1) {
+                close(this->_read_fd);
+            }
+
+            if(this->_write_fd != -1 && this->_write_fd != this->_read_fd) {
+                close(this->_write_fd);
+            }
+        }
+
+        // Descriptor to poll for POLLIN
+        int fd() const {
+            return this->_read_fd;
+        }
+
+        void notify() {
+            if(this->_notified.exchange(true, std::memory_order_acq_rel)) {
+                return;
+            }
+
+            std::uint64_t increment = 1;
+            ssize_t       written   = write(this->_write_fd, &increment, sizeof(increment));
+
+            static_cast<void>(written);
+        }
+
+        // Resets the descriptor. Call it before handling the work that has been notified.
+        void drain() {
+            std::uint64_t counter[8];
+
+            this->_notified.store(false, std::memory_order_release);
+
+            while(read(this->_read_fd, counter, sizeof(counter)) > 0) {
+            }
+        }
+
+    private:
+
+        int _read_fd  = -1;
+        int _write_fd = -1;
+        std::atomic<bool> _notified { false };
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include "jam.dmxusbpro.frame_ring.hpp"
+
+#define MAX_EVENT_VALUE_COUNT                3
+#define MAX_EVENT_TEXT_SIZE                  48 // fits the longest console message sent from the I/O thread
+
+
+// What a max_event_t carries and how the Max thread sends it out
+enum class MaxEventType : std::uint8_t {
+    CONNECTION_STATE, // values[0]: 1 connected, 0 closed
+    DEVICE_SETTINGS,  // text: firmware version, values: break time, MAB time, refresh rate
+    SERIAL_NUMBER,    // text: serial number
+    TEXT              // text, sent as a symbol
+};
+
+// Event handed from the I/O and Max threads to the Max thread of jam.dmxusbpro and jam.dmxusbpro~.
+// The destination (TO_OUTLET_..., TO_MAX_CONSOLE...) is stored apart from the payload, which is
+// turned into atoms only when it is sent out.
+typedef struct {
+    std::uint8_t destination;
+    MaxEventType type;
+    int values[MAX_EVENT_VALUE_COUNT];
+    char text[MAX_EVENT_TEXT_SIZE];
+} max_event_t;
+
+
+typedef MpscRing<max_event_t, 64> max_event_queue_t;
+
+
+inline bool enqueMaxEvent(max_event_queue_t &queue, std::uint8_t destination, MaxEventType type, std::initializer_list<int> values, const char *text = "") {
+    return queue.tryPush([destination, type, values, text](max_event_t &event) {
+        event.destination = destination;
+        event.type        = type;
+        std::fill(event.values, event.values + MAX_EVENT_VALUE_COUNT, 0);
+        std::copy_n(values.begin(), std::min<std::size_t>(values.size(), MAX_EVENT_VALUE_COUNT), event.values);
+        strncpy(event.text, text, MAX_EVENT_TEXT_SIZE - 1);
+        event.text[MAX_EVENT_TEXT_SIZE - 1] = '\0';
+    });
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "jam.dmxusbpro.dmx_device.hpp"
+
+
+// Incremental parser for messages sent by the widget: [start, label, length lsb, length msb, data..., end].
+// Bytes are fed as they come from read(); a message may be split over several reads and a read may hold
+// several messages. Garbage before a start byte is skipped and a message whose end byte doesn't match
+// is dropped, after which the parser resynchronises on the next start byte.
+// Complete messages are reported as [start ... end] to a callback. Messages that arrive in one read
+// are reported straight from the read buffer, only split messages are assembled in the parser.
+// Every connection owns its own parser.
+class EnttecMessageParser {
+
+    typedef std::chrono::steady_clock clock_t;
+
+    enum class State {
+        START,
+        LABEL,
+        LENGTH_LSB,
+        LENGTH_MSB,
+        DATA,
+        END
+    };
+
+    public:
+
+        static constexpr std::size_t max_message_size = SERIAL_IN_BUFF_SIZE;
+        static constexpr std::size_t overhead_size    = 5; // start, label, 2 length bytes, end
+
+        // CALLBACK: void(const unsigned char *message, std::size_t length)
+        template<typename CALLBACK>
+        void parse(const unsigned char *bytes, std::size_t count, CALLBACK on_message) {
+            std::size_t i = 0;
+
+            while(i < count) {
+                if(this->_state == State::START) {
+                    // Skip garbage up to the next start byte
+                    const void *start = memchr(bytes + i, MSG_START_CONDITION, count - i);
+
+                    if(start == nullptr) {
+                        this->_skipped_bytes += count - i;
+                        break;
+                    }
+
+                    std::size_t start_index = (const unsigned char*)start - bytes;
+
+                    if(start_index != i) {
+                        this->_skipped_bytes += start_index - i;
+                        this->_resync_count++;
+                    }
+
+                    i = start_index;
+
+                    // Fast path: the whole message is in this buffer
+                    if(count - i >= overhead_size - 1) {
+                        std::size_t data_length    = this->_dataLength(bytes[i + 2], bytes[i + 3]);
+                        std::size_t message_length = data_length + overhead_size;
+
+                        if(message_length > max_message_size) {
+                            this->_resync_count++;
+                            i++;
+                            continue;
+                        }
+
+                        if(count - i >= message_length) {
+                            if(bytes[i + message_length - 1] == MSG_END_CONDITION) {
+                                on_message(bytes + i, message_length);
+                                i += message_length;
+                            } else {
+                                // Not a message after all, search for the next start byte
+                                this->_resync_count++;
+                                i++;
+                            }
+
+                            continue;
+                        }
+                    }
+                }
+
+                this->_consume(bytes[i], on_message);
+                i++;
+            }
+
+            // A message started in this buffer is still incomplete: start its timeout
+            if(this->_state != State::START && this->_needs_start_time) {
+                this->_message_start_time = clock_t::now();
+                this->_needs_start_time   = false;
+            }
+        }
+
+        // Drops a partially received message that didn't complete within 'timeout'.
+        // Returns true if a message has been dropped.
+        bool expire(clock_t::time_point now, std::chrono::milliseconds timeout) {
+            if(this->_state == State::START || now - this->_message_start_time <= timeout) {
+                return false;
+            }
+
+            this->reset();
+            this->_timeout_count++;
+            return true;
+        }
+
+        void reset() {
+            this->_state = State::START;
+            this->_index = 0;
+        }
+
+        bool isParsing() const {
+            return this->_state != State::START;
+        }
+
+        std::uint64_t resyncCount() const {
+            return this->_resync_count;
+        }
+
+        std::uint64_t timeoutCount() const {
+            return this->_timeout_count;
+        }
+
+        std::uint64_t skippedBytes() const {
+            return this->_skipped_bytes;
+        }
+
+    private:
+
+        unsigned char _message[max_message_size];
+        std::size_t _index          = 0;
+        std::size_t _message_length = 0;
+        State _state                = State::START;
+        bool _needs_start_time      = false;
+        clock_t::time_point _message_start_time;
+        std::atomic<std::uint64_t> _resync_count { 0 };  // counters are read by the Max thread
+        std::atomic<std::uint64_t> _timeout_count { 0 };
+        std::atomic<std::uint64_t> _skipped_bytes { 0 };
+
+        static std::size_t _dataLength(unsigned char lsb, unsigned char msb) {
+            return (std::size_t)(((std::uint16_t)msb << 8) | (std::uint16_t)lsb);
+        }
+
+        // Byte by byte assembly of a message split over several reads
+        template<typename CALLBACK>
+        void _consume(unsigned char byte, CALLBACK &on_message) {
+            switch (this->_state) {
+                case State::START:
+                    if(byte == MSG_START_CONDITION) {
+                        this->_message[0]       = byte;
+                        this->_index            = 1;
+                        this->_state            = State::LABEL;
+                        this->_needs_start_time = true;
+                    }
+
+                    return;
+
+                case State::LABEL:
+                    this->_message[this->_index++] = byte;
+                    this->_state = State::LENGTH_LSB;
+                    return;
+
+                case State::LENGTH_LSB:
+                    this->_message[this->_index++] = byte;
+                    this->_state = State::LENGTH_MSB;
+                    return;
+
+                case State::LENGTH_MSB:
+                    this->_message[this->_index++] = byte;
+                    this->_message_length          = this->_dataLength(this->_message[2], byte) + overhead_size;
+
+                    if(this->_message_length > max_message_size) {
+                        this->_resync_count++;
+                        this->reset();
+                        return;
+                    }
+
+                    this->_state = this->_message_length == overhead_size ? State::END : State::DATA;
+                    return;
+
+                case State::DATA:
+                    this->_message[this->_index++] = byte;
+
+                    if(this->_index == this->_message_length - 1) {
+                        this->_state = State::END;
+                    }
+
+                    return;
+
+                case State::END:
+                    this->reset();
+
+                    if(byte == MSG_END_CONDITION) {
+                        this->_message[this->_message_length - 1] = byte;
+                        on_message(this->_message, this->_message_length);
+                        return;
+                    }
+
+                    // Corrupt message. The unexpected byte may already start the next one.
+                    this->_resync_count++;
+
+                    if(byte == MSG_START_CONDITION) {
+                        this->_consume(byte, on_message);
+                    }
+
+                    return;
+            }
+        }
+};
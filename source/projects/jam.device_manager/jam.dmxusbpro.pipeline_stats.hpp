@@ -0,0 +1,153 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#define LATENCY_BUCKET_COUNT                 24 // power of two microsecond buckets, the last one holds 2^22 us and more
+
+
+// Lock-free latency histogram. Bucket n counts durations of 2^(n-1) up to 2^n - 1 microseconds,
+// so recording a sample costs a few shifts and relaxed atomic operations.
+// Written by one thread at a time, read from any thread.
+class LatencyHistogram {
+
+    public:
+
+        typedef struct {
+            std::uint64_t count;
+            double mean_us;
+            std::uint64_t p50_us; // upper bounds of the buckets holding the percentiles
+            std::uint64_t p99_us;
+            std::uint64_t max_us;
+        } summary_t;
+
+        void record(std::chrono::steady_clock::duration duration) {
+            std::int64_t  signed_us = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+            std::uint64_t us        = signed_us > 0 ? (std::uint64_t)signed_us : 0;
+
+            this->_buckets[_bucketIndex(us)].fetch_add(1, std::memory_order_relaxed);
+            this->_sum_us.fetch_add(us, std::memory_order_relaxed);
+
+            if(us > this->_max_us.load(std::memory_order_relaxed)) {
+                this->_max_us.store(us, std::memory_order_relaxed);
+            }
+        }
+
+        summary_t summary() const {
+            std::uint64_t bucket_counts[LATENCY_BUCKET_COUNT];
+            std::uint64_t count = 0;
+            summary_t     result;
+
+            for(std::size_t i = 0; i < LATENCY_BUCKET_COUNT; i++) {
+                bucket_counts[i] = this->_buckets[i].load(std::memory_order_relaxed);
+                count           += bucket_counts[i];
+            }
+
+            result.count   = count;
+            result.mean_us = count > 0 ? (double)this->_sum_us.load(std::memory_order_relaxed) / (double)count : 0.;
+            result.p50_us  = _percentile(bucket_counts, count, 0.5);
+            result.p99_us  = _percentile(bucket_counts, count, 0.99);
+            result.max_us  = this->_max_us.load(std::memory_order_relaxed);
+            return result;
+        }
+
+    private:
+
+        std::atomic<std::uint64_t> _buckets[LATENCY_BUCKET_COUNT] {};
+        std::atomic<std::uint64_t> _sum_us { 0 };
+        std::atomic<std::uint64_t> _max_us { 0 };
+
+        static std::size_t _bucketIndex(std::uint64_t us) {
+            std::size_t index = 0;
+
+            while(us != 0 && index < LATENCY_BUCKET_COUNT - 1) {
+                us >>= 1;
+                index++;
+            }
+
+            return index;
+        }
+
+        static std::uint64_t _percentile(const std::uint64_t (&bucket_counts)[LATENCY_BUCKET_COUNT], std::uint64_t count, double percentile) {
+            std::uint64_t rank       = (std::uint64_t)(percentile * (double)count);
+            std::uint64_t cumulative = 0;
+
+            if(count == 0) {
+                return 0;
+            }
+
+            for(std::size_t i = 0; i < LATENCY_BUCKET_COUNT; i++) {
+                cumulative += bucket_counts[i];
+
+                if(cumulative > rank) {
+                    return ((std::uint64_t)1 << i) - 1;
+                }
+            }
+
+            return ((std::uint64_t)1 << (LATENCY_BUCKET_COUNT - 1)) - 1;
+        }
+};
+
+
+// Counters of the DMX pipeline of one jam.dmxusbpro(~) instance, updated by the audio, Max and I/O
+// threads with relaxed atomics and read by the 'stats' message.
+class PipelineStats {
+
+    typedef std::chrono::steady_clock clock_t;
+
+    public:
+
+        std::atomic<std::uint64_t> frames_sent { 0 };
+        std::atomic<std::uint64_t> bytes_written { 0 };
+        std::atomic<std::uint64_t> write_errors { 0 };
+        std::atomic<std::uint64_t> write_stalls { 0 };     // writes the driver didn't take completely
+        std::atomic<std::uint64_t> frames_replaced { 0 };  // 'latest' frames overwritten before they were written
+        std::atomic<std::uint64_t> frames_overflowed { 0 }; // frames dropped because their queue was full
+        std::atomic<std::uint64_t> frames_received { 0 };
+        std::atomic<std::uint64_t> send_queue_depth_max { 0 };
+        LatencyHistogram enqueue_to_write;
+        LatencyHistogram write_duration;
+
+        void recordSendQueueDepth(std::uint64_t depth) {
+            if(depth > this->send_queue_depth_max.load(std::memory_order_relaxed)) {
+                this->send_queue_depth_max.store(depth, std::memory_order_relaxed);
+            }
+        }
+
+        // Frames per second sent and received since the previous call. Max thread only.
+        void rates(double &sent_per_second, double &received_per_second) {
+            std::uint64_t received = this->frames_received.load(std::memory_order_relaxed);
+            double        elapsed  = this->_sendRate(sent_per_second);
+
+            received_per_second   = elapsed > 0. ? (double)(received - this->_rates_received) / elapsed : 0.;
+            this->_rates_received = received;
+        }
+
+        // Frames per second sent since the previous call, for instances that don't receive DMX. Max thread only.
+        double sendRate() {
+            double sent_per_second;
+
+            this->_sendRate(sent_per_second);
+            return sent_per_second;
+        }
+
+    private:
+
+        clock_t::time_point _rates_time = clock_t::now();
+        std::uint64_t _rates_sent       = 0;
+        std::uint64_t _rates_received   = 0;
+
+        // Returns the seconds since the previous call
+        double _sendRate(double &sent_per_second) {
+            clock_t::time_point now     = clock_t::now();
+            std::uint64_t       sent    = this->frames_sent.load(std::memory_order_relaxed);
+            double              elapsed = std::chrono::duration<double>(now - this->_rates_time).count();
+
+            sent_per_second   = elapsed > 0. ? (double)(sent - this->_rates_sent) / elapsed : 0.;
+            this->_rates_time = now;
+            this->_rates_sent = sent;
+            return elapsed;
+        }
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+
+// Maps the sample position of one jam.dmxusbpro~ instance to steady_clock time, so DMX frames
+// computed on the audio thread can be released by the I/O thread evenly spaced on the audio timeline.
+// Signal vectors are computed in bursts ahead of time, so the clock follows the latest start of a
+// vector relative to the sample count: it jumps forward when a vector starts later than predicted and
+// moves back by the smallest lead seen once per second, when the audio clock runs faster.
+// Audio thread only.
+class SampleClock {
+
+    typedef std::chrono::steady_clock clock_t;
+
+    public:
+
+        // Called at the start of every signal vector
+        void startVector(clock_t::time_point now, double samplerate, std::size_t frame_count) {
+            this->_position          += this->_vector_frame_count;
+            this->_vector_frame_count = frame_count;
+
+            if(samplerate != this->_samplerate) {
+                this->_samplerate = samplerate;
+                this->_anchor(now);
+                return;
+            }
+
+            clock_t::duration deviation = now - this->_timeAt(this->_position);
+
+            if(deviation > clock_t::duration::zero()) {
+                this->_anchor(now);
+                return;
+            }
+
+            if(deviation > this->_window_lead) {
+                this->_window_lead = deviation;
+            }
+
+            if(this->_position >= this->_window_end) {
+                this->_anchor_time += this->_window_lead;
+                this->_startWindow();
+            }
+        }
+
+        // Time at which sample 'offset' of the current signal vector is due
+        clock_t::time_point timeOf(std::size_t offset) const {
+            return this->_timeAt(this->_position + offset);
+        }
+
+    private:
+
+        double _samplerate                 = 0.;
+        std::uint64_t _position            = 0; // first sample of the current vector
+        std::size_t _vector_frame_count    = 0;
+        clock_t::time_point _anchor_time;
+        std::uint64_t _anchor_position     = 0;
+        clock_t::duration _window_lead     = clock_t::duration::min(); // largest deviation of the current window, <= 0
+        std::uint64_t _window_end          = 0;
+
+        clock_t::time_point _timeAt(std::uint64_t position) const {
+            std::chrono::duration<double> elapsed((double)(position - this->_anchor_position) / this->_samplerate);
+
+            return this->_anchor_time + std::chrono::duration_cast<clock_t::duration>(elapsed);
+        }
+
+        void _anchor(clock_t::time_point now) {
+            this->_anchor_time     = now;
+            this->_anchor_position = this->_position;
+            this->_startWindow();
+        }
+
+        void _startWindow() {
+            this->_window_lead = clock_t::duration::min();
+            this->_window_end  = this->_position + (std::uint64_t)this->_samplerate;
+        }
+};
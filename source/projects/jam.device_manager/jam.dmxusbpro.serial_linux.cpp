@@ -0,0 +1,58 @@
+#if defined(__linux__)
+
+// The kernel's termios2 is declared in <asm/termbits.h>, whose struct termios clashes with the
+// one from <termios.h>. Everything that needs it lives in this file.
+#include <asm/termbits.h>
+#include <linux/serial.h>
+#include <sys/ioctl.h>
+
+bool linuxSetBaudRate(int fd, unsigned int baud_rate);
+bool linuxSetLowLatency(int fd);
+
+#define BAUD_RATE_TOLERANCE                  2 // percent the rate set by the driver may differ from the requested one
+
+
+static bool _isCloseToBaudRate(unsigned int actual_rate, unsigned int baud_rate) {
+    unsigned int difference = actual_rate > baud_rate ? actual_rate - baud_rate : baud_rate - actual_rate;
+
+    return (unsigned long long)difference * 100 <= (unsigned long long)baud_rate * BAUD_RATE_TOLERANCE;
+}
+
+bool linuxSetBaudRate(int fd, unsigned int baud_rate) {
+    struct termios2 options;
+
+    if (ioctl(fd, TCGETS2, &options) == -1) {
+        return false;
+    }
+
+    options.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+    options.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+    options.c_ispeed = baud_rate;
+    options.c_ospeed = baud_rate;
+
+    if (ioctl(fd, TCSETS2, &options) == -1) {
+        return false;
+    }
+
+    // Check that speed is properly modified. Drivers report the rate of the divisor they picked,
+    // which may be off by a little: both ends stay in sync within BAUD_RATE_TOLERANCE.
+    if (ioctl(fd, TCGETS2, &options) == -1) {
+        return false;
+    }
+
+    return _isCloseToBaudRate(options.c_ispeed, baud_rate) && _isCloseToBaudRate(options.c_ospeed, baud_rate);
+}
+
+bool linuxSetLowLatency(int fd) {
+    struct serial_struct serial_info;
+
+    if (ioctl(fd, TIOCGSERIAL, &serial_info) == -1) {
+        return false;
+    }
+
+    serial_info.flags |= ASYNC_LOW_LATENCY;
+
+    return ioctl(fd, TIOCSSERIAL, &serial_info) != -1;
+}
+
+#endif
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+
+// How jam.dmxusbpro~ reduces the samples of a push interval to a single DMX value
+enum class ReduceMode {
+    FIRST,
+    LAST,
+    MEAN,
+    PEAK,
+    RMS
+};
+
+
+// Accumulates the signal vectors of one channel until the push interval ends.
+// Sums and maxima are computed 4 (AVX) or 2 (SSE2, NEON) samples at a time.
+class SignalReducer {
+
+    public:
+
+        void accumulate(const double *samples, std::size_t count, ReduceMode mode) {
+            if(count == 0) {
+                return;
+            }
+
+            switch (mode) {
+                case ReduceMode::FIRST:
+                    if(this->_count == 0) {
+                        this->_value = samples[0];
+                    }
+
+                    break;
+
+                case ReduceMode::LAST:
+                    this->_value = samples[count - 1];
+                    break;
+
+                case ReduceMode::MEAN:
+                    this->_value += _sum(samples, count);
+                    break;
+
+                case ReduceMode::PEAK:
+                    this->_value = this->_count == 0 ? _max(samples, count) : std::max(this->_value, _max(samples, count));
+                    break;
+
+                case ReduceMode::RMS:
+                    this->_value += _sumOfSquares(samples, count);
+                    break;
+            }
+
+            this->_count += count;
+        }
+
+        // Reduced value of the samples accumulated since the last reset()
+        double value(ReduceMode mode) const {
+            if(this->_count == 0) {
+                return 0.;
+            }
+
+            switch (mode) {
+                case ReduceMode::MEAN:
+                    return this->_value / (double)this->_count;
+
+                case ReduceMode::RMS:
+                    return std::sqrt(this->_value / (double)this->_count);
+
+                default:
+                    return this->_value;
+            }
+        }
+
+        void reset() {
+            this->_value = 0.;
+            this->_count = 0;
+        }
+
+    private:
+
+        double _value      = 0.;
+        std::size_t _count = 0;
+
+        static double _sum(const double *samples, std::size_t count) {
+            std::size_t i   = 0;
+            double      sum = 0.;
+
+#if defined(__AVX__)
+            __m256d sum_vector = _mm256_setzero_pd();
+
+            for(; i + 4 <= count; i += 4) {
+                sum_vector = _mm256_add_pd(sum_vector, _mm256_loadu_pd(samples + i));
+            }
+
+            __m128d half_sum = _mm_add_pd(_mm256_castpd256_pd128(sum_vector), _mm256_extractf128_pd(sum_vector, 1));
+
+            sum = _mm_cvtsd_f64(_mm_add_sd(half_sum, _mm_unpackhi_pd(half_sum, half_sum)));
+#elif defined(__SSE2__) || defined(_M_X64)
+            __m128d sum_vector = _mm_setzero_pd();
+
+            for(; i + 2 <= count; i += 2) {
+                sum_vector = _mm_add_pd(sum_vector, _mm_loadu_pd(samples + i));
+            }
+
+            sum = _mm_cvtsd_f64(_mm_add_sd(sum_vector, _mm_unpackhi_pd(sum_vector, sum_vector)));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+            float64x2_t sum_vector = vdupq_n_f64(0.);
+
+            for(; i + 2 <= count; i += 2) {
+                sum_vector = vaddq_f64(sum_vector, vld1q_f64(samples + i));
+            }
+
+            sum = vaddvq_f64(sum_vector);
+#endif
+
+            for(; i < count; i++) {
+                sum += samples[i];
+            }
+
+            return sum;
+        }
+
+        static double _sumOfSquares(const double *samples, std::size_t count) {
+            std::size_t i   = 0;
+            double      sum = 0.;
+
+#if defined(__AVX__)
+            __m256d sum_vector = _mm256_setzero_pd();
+
+            for(; i + 4 <= count; i += 4) {
+                __m256d sample_vector = _mm256_loadu_pd(samples + i);
+
+                sum_vector = _mm256_add_pd(sum_vector, _mm256_mul_pd(sample_vector, sample_vector));
+            }
+
+            __m128d half_sum = _mm_add_pd(_mm256_castpd256_pd128(sum_vector), _mm256_extractf128_pd(sum_vector, 1));
+
+            sum = _mm_cvtsd_f64(_mm_add_sd(half_sum, _mm_unpackhi_pd(half_sum, half_sum)));
+#elif defined(__SSE2__) || defined(_M_X64)
+            __m128d sum_vector = _mm_setzero_pd();
+
+            for(; i + 2 <= count; i += 2) {
+                __m128d sample_vector = _mm_loadu_pd(samples + i);
+
+                sum_vector = _mm_add_pd(sum_vector, _mm_mul_pd(sample_vector, sample_vector));
+            }
+
+            sum = _mm_cvtsd_f64(_mm_add_sd(sum_vector, _mm_unpackhi_pd(sum_vector, sum_vector)));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+            float64x2_t sum_vector = vdupq_n_f64(0.);
+
+            for(; i + 2 <= count; i += 2) {
+                float64x2_t sample_vector = vld1q_f64(samples + i);
+
+                sum_vector = vfmaq_f64(sum_vector, sample_vector, sample_vector);
+            }
+
+            sum = vaddvq_f64(sum_vector);
+#endif
+
+            for(; i < count; i++) {
+                sum += samples[i] * samples[i];
+            }
+
+            return sum;
+        }
+
+        static double _max(const double *samples, std::size_t count) {
+            std::size_t i       = 1;
+            double      maximum = samples[0];
+
+#if defined(__AVX__)
+            if(count >= 4) {
+                __m256d max_vector = _mm256_loadu_pd(samples);
+
+                for(i = 4; i + 4 <= count; i += 4) {
+                    max_vector = _mm256_max_pd(max_vector, _mm256_loadu_pd(samples + i));
+                }
+
+                __m128d half_max = _mm_max_pd(_mm256_castpd256_pd128(max_vector), _mm256_extractf128_pd(max_vector, 1));
+
+                maximum = _mm_cvtsd_f64(_mm_max_sd(half_max, _mm_unpackhi_pd(half_max, half_max)));
+            }
+#elif defined(__SSE2__) || defined(_M_X64)
+            if(count >= 2) {
+                __m128d max_vector = _mm_loadu_pd(samples);
+
+                for(i = 2; i + 2 <= count; i += 2) {
+                    max_vector = _mm_max_pd(max_vector, _mm_loadu_pd(samples + i));
+                }
+
+                maximum = _mm_cvtsd_f64(_mm_max_sd(max_vector, _mm_unpackhi_pd(max_vector, max_vector)));
+            }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+            if(count >= 2) {
+                float64x2_t max_vector = vld1q_f64(samples);
+
+                for(i = 2; i + 2 <= count; i += 2) {
+                    max_vector = vmaxq_f64(max_vector, vld1q_f64(samples + i));
+                }
+
+                maximum = vmaxvq_f64(max_vector);
+            }
+#endif
+
+            for(; i < count; i++) {
+                maximum = std::max(maximum, samples[i]);
+            }
+
+            return maximum;
+        }
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include "jam.dmxusbpro.dmx_convert.hpp"
+#include "jam.dmxusbpro.signal_reduce.hpp"
+
+
+// Updates of the DMX universe done on the hot paths of jam.dmxusbpro and jam.dmxusbpro~.
+// Kept apart from the objects so jam.dmxusbpro_bench measures the same code.
+class UniverseUpdate {
+
+    public:
+
+        // The 'list' message: sets channel / value pairs, channels clamped to 1 - 512 and values to 0 - 255.
+        // Returns the highest channel set, 0 if 'pairs' is empty.
+        // PAIRS: indexable, even sized, elements convertible to int
+        template<typename PAIRS>
+        static int setPairs(unsigned char (&universe)[512], const PAIRS &pairs, std::size_t size) {
+            int highest_channel = 0;
+
+            for(std::size_t i = 0; i + 1 < size; i = i + 2) {
+                int dmx_channel = std::min(512, std::max(1, (int)pairs[i]));
+                int dmx_val     = std::min(255, std::max(0, (int)pairs[i + 1]));
+
+                universe[dmx_channel - 1] = (unsigned char)dmx_val;
+                highest_channel           = std::max(highest_channel, dmx_channel);
+            }
+
+            return highest_channel;
+        }
+
+        // Converts the values of 'count' reducers, scaled by 'scale', to the DMX channels from 'channels' on
+        // in one vectorised pass. Returns true if a channel has changed.
+        static bool fromReducers(const SignalReducer *reducers, std::size_t count, ReduceMode mode, float scale, unsigned char *channels) {
+            float         samples[512];
+            unsigned char dmx_values[512];
+
+            count = std::min<std::size_t>(count, 512);
+
+            for(std::size_t i = 0; i < count; i++) {
+                samples[i] = (float)reducers[i].value(mode);
+            }
+
+            DmxConvert::fromFloats(samples, dmx_values, count, scale);
+
+            if(memcmp(dmx_values, channels, count) == 0) {
+                return false;
+            }
+
+            memcpy(channels, dmx_values, count);
+            return true;
+        }
+
+        // jam.dmxusbpro~'s argument inlets: the value of reducer n, scaled by 'master', sets DMX channel
+        // 'dmx_channels[n]'. 'pushed_values' holds the value last pushed per inlet, -1 before the first push.
+        // Returns true if a channel has changed.
+        static bool fromInletReducers(const SignalReducer *reducers, std::size_t count, ReduceMode mode, double master,
+                                      const int *dmx_channels, int *pushed_values, unsigned char (&universe)[512]) {
+            bool has_changed = false;
+
+            for(std::size_t i = 0; i < count; i++) {
+                double        channel_sample = std::min(1., std::max(0., reducers[i].value(mode)));
+                unsigned char dmx_value      = (unsigned char)std::round(channel_sample * master * 255.);
+                unsigned char &dmx_channel   = universe[dmx_channels[i] - 1];
+
+                if(dmx_value != pushed_values[i] || dmx_value != dmx_channel) {
+                    pushed_values[i] = dmx_value;
+                    dmx_channel      = dmx_value;
+                    has_changed      = true;
+                }
+            }
+
+            return has_changed;
+        }
+};
@@ -4,13 +4,25 @@
 ///	@license	Use of this source code is governed by the MIT License found in the License.md file.
 
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <chrono>
 #include <cstddef>
 #include <mutex>
-#include <queue>
 #include <thread>
 #include <vector>
+#include "../jam.device_manager/jam.dmxusbpro.device_writer.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.dmx_convert.hpp"
 #include "../jam.device_manager/jam.dmxusbpro.dmx_device.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.dmx_diff.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.dmx_frame.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.frame_ring.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.frame_slot.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.io_reactor.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.max_event.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.message_parser.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.pipeline_stats.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.universe_update.hpp"
 #include "c74_min.h"
 
 #define OBJECT_MESSAGE_PREFIX                "jam.dmxusbpro • "
@@ -19,38 +31,120 @@
 using namespace c74::min;
 namespace s_chrono = std::chrono;
 
-class dmxusbpro : public object<dmxusbpro>
+class dmxusbpro : public object<dmxusbpro>, public IoClient
 {
 
     protected:
 
         bool _blackout            = false;
-        bool _io_threads_continue = false;
-        std::thread _receive_thread;
-        std::thread _send_thread;
+        std::atomic<bool> _device_lost { false };
+        std::atomic<bool> _is_connected { false };
+        Connector::connection_t _connection;
         std::mutex _open_device_lock;
-        std::mutex _enque_msg_lock;
-        std::queue<std::vector<unsigned char> > _messages_to_device_queue;
+        std::mutex _frame_store_lock;
+        device_message_queue_t _messages_to_device_queue;
+        LatestFrameSlot<dmx_frame_t> _latest_dmx_frame;
         std::string _open_device_name = "";
-        fifo<atoms> _to_max_queue { 1000 };
+        max_event_queue_t _max_events;
+        std::atomic<bool> _delivery_scheduled { false };
+        std::atomic<int> _highest_channel { 0 };
         unsigned char _dmx_universe[512];
         unsigned char _dmx_blackout[512];
+        device_input_queue_t _dmx_input_queue;
+        std::atomic<bool> _reset_dmx_input { false };
+        unsigned char _dmx_input[DMX_SLOTS]; // last received DMX: start code and channels. Max thread only.
+        std::size_t _dmx_input_count = 0;
+        atoms _dmx_output;
+        buffer_reference _output_buffer { this };
+        buffer_reference _input_buffer { this };
         unsigned char _serial_in_buffer[SERIAL_IN_BUFF_SIZE];
+        EnttecMessageParser _device_parser;
+        DeviceWriter _device_writer; // send thread only
+        PipelineStats _stats;
         dict _connections { symbol("__jamproconnections__") }; // Workaround until I find a way to make the device manager global
 
-        void _enque_msg_to_max(const atoms &msg_to_max) {
-            _enque_msg_lock.lock();
-            this->_to_max_queue.try_enqueue(msg_to_max);
-            _enque_msg_lock.unlock();
+        void _enqueMaxEvent(std::uint8_t destination, MaxEventType type, std::initializer_list<int> values, const char *text = "") {
+            enqueMaxEvent(this->_max_events, destination, type, values, text);
+            this->_scheduleDelivery();
         }
 
-        bool _dequeue_msg_to_max(atoms &msg_data) {
-            _enque_msg_lock.lock();
+        // Wakes the Max thread once for everything queued until deliverer_to_max runs
+        void _scheduleDelivery() {
+            if(!this->_delivery_scheduled.exchange(true, std::memory_order_acq_rel)) {
+                deliverer_to_max.delay(0);
+            }
+        }
+
+        void _sendToMax(std::uint8_t destination, const atoms &message) {
+            switch (destination) {
+                case TO_OUTLET_1:
+                    output_1.send(message);
+                    break;
+
+                case TO_OUTLET_2:
+                    output_2.send(message);
+                    break;
+
+                case TO_OUTLET_3:
+                    output_3.send(message);
+                    break;
+
+                case TO_OUTLET_DUMPOUT:
+                    output_dumpout.send(message);
+                    break;
+
+                case TO_MAX_CONSOLE:
+
+                    for(std::size_t i = 0; i < message.size(); i++) {
+                        cout << message[i] << endl;
+                    }
+
+                    break;
 
-            bool result = this->_to_max_queue.try_dequeue(msg_data);
+                case TO_MAX_CONSOLE_WARN:
 
-            _enque_msg_lock.unlock();
-            return result;
+                    for(std::size_t i = 0; i < message.size(); i++) {
+                        cwarn << message[i] << endl;
+                    }
+
+                    break;
+
+                case TO_MAX_CONSOLE_ERROR:
+
+                    for(std::size_t i = 0; i < message.size(); i++) {
+                        cerr << message[i] << endl;
+                    }
+
+                    break;
+            }
+        }
+
+        void _sendHistogram(const char *name, const LatencyHistogram::summary_t &summary) {
+            output_dumpout.send(name, (long)summary.count, summary.mean_us, (long)summary.p50_us, (long)summary.p99_us, (long)summary.max_us);
+        }
+
+        // Turns an event into atoms and sends it out. Max thread only.
+        void _deliverMaxEvent(const max_event_t &event) {
+            switch (event.type) {
+                case MaxEventType::CONNECTION_STATE:
+                    this->_sendToMax(event.destination, { event.values[0] });
+                    break;
+
+                case MaxEventType::DEVICE_SETTINGS:
+                    this->_sendToMax(event.destination, { "firmware", symbol(event.text) });
+                    this->_sendToMax(event.destination, { "breaktime", event.values[0] });
+                    this->_sendToMax(event.destination, { "mabtime", event.values[1] });
+                    this->_sendToMax(event.destination, { "refresh", event.values[2] });
+                    break;
+
+                case MaxEventType::SERIAL_NUMBER:
+                    this->_sendToMax(event.destination, { "serialnumber", symbol(event.text) });
+                    break;
+
+                case MaxEventType::TEXT:
+                    this->_sendToMax(event.destination, { symbol(event.text) });
+                    break;
+            }
         }
 
         void _setOpenDeviceName(std::string device_name) {
@@ -64,10 +158,10 @@ class dmxusbpro : public object<dmxusbpro>
         }
 
         void _closeDevice() {
-            if(Connector::get().isConnected(this->_getOpenDeviceName())) {
+            if(this->_is_connected) {
 
                 if(!keepsending) {
-                    this->_messages_to_device_queue.push(std::vector<unsigned char> {
+                    this->_enqueMsgToDevice({
                     MSG_START_CONDITION,
                     MSG_LABEL_RECEIVE_DMX,
                     0x01, 0x00, 0x00,
@@ -78,258 +172,587 @@ class dmxusbpro : public object<dmxusbpro>
                 // wait for message to be sent
                 std::this_thread::sleep_for(s_chrono::milliseconds(50));
 
-                this->_io_threads_continue = false;
+                Connector::get().reactor().remove(this);
 
-                if (Connector::get().closeSerialPort(this->_getOpenDeviceName()) != 0) {
+                if (Connector::get().closeSerialPort(this->_connection) != 0) {
                     cerr << "Error closing serial port." << endl;
                 }
 
+                this->_is_connected = false;
+                this->_connection.reset();
+
                 this->_connections[this->_open_device_name] = 0;
                 this->_open_device_name                     = "";
-                static_cast<void>(this->_messages_to_device_queue.empty());
+                if(verbose && this->_messages_to_device_queue.overflowCount() > 0) {
+                    cwarn << this->_messages_to_device_queue.overflowCount() << " messages to the device dropped: send queue full." << endl;
+                }
+
+                this->_latest_dmx_frame.clear();
             }
 
-            atoms connection_state;
+            this->_enqueMaxEvent(TO_OUTLET_2, MaxEventType::CONNECTION_STATE, { 0 });
+        }
+
+        // Called from the I/O reactor thread when the connection broke. Closing is done on the Max thread.
+        void _deviceLost(const char *reason) {
+            if(this->_device_lost.exchange(true)) {
+                return;
+            }
 
-            connection_state.push_back(TO_OUTLET_2);
-            connection_state.push_back(0);
-            _enque_msg_to_max(connection_state);
-            deliverer_to_max.delay(0);
+            this->_enqueMaxEvent(TO_MAX_CONSOLE_ERROR, MaxEventType::TEXT, {}, reason);
+            device_closer.delay(0);
         }
 
-        void _sendThreadTask() {
-            atoms to_max;
+        void onIoSend(int fd) override {
+            this->_sendPendingMessages(fd);
+        }
 
-            if(Connector::get().isConnected(this->_getOpenDeviceName())) {
-                // Test if the device is still connected
-                if (Connector::get().connectionState(this->_getOpenDeviceName()) != Connector::ConnectionState::OK) {
-                    return;
-                }
+        void onIoReceive(int fd) override {
+            this->_receiveFromDevice(fd);
+        }
 
-                if(_messages_to_device_queue.size() > 0 ) {
-                    std::vector<unsigned char> msg_bytes = _messages_to_device_queue.front();
+        void onIoError(int fd, short poll_events) override {
+            this->_connection->setState(Connector::ConnectionState::MISSING);
+            this->_deviceLost("Device disconnected");
+        }
 
-                    _messages_to_device_queue.pop();
+        void onIoTick(int fd, s_chrono::steady_clock::time_point now) override {
+            if(this->_device_lost) {
+                return;
+            }
 
-                    std::size_t                msg_size = msg_bytes.size();
-                    char                       msg_buffer[msg_bytes.size()];
+            // Fallback: drop a response that isn't received completly within RESPONSE_TIMEOUT
+            if(this->_device_parser.expire(now, s_chrono::milliseconds(RESPONSE_TIMEOUT)) && verbose) {
+                this->_enqueMaxEvent(TO_MAX_CONSOLE_WARN, MaxEventType::TEXT, {}, "timeout receiving device response");
+            }
 
-                    for(std::size_t i = 0; i < msg_bytes.size(); i++) {
-                        msg_buffer[i] = msg_bytes[i];
-                    }
+            // Test if the device conntion is healthy. The termios check runs at the 'healthcheck' rate,
+            // unplugging is usually noticed earlier by poll() or a failing read() / write().
+            this->_handleConnectionState(this->_connection->monitor(now));
+        }
 
-                    std::size_t                success = write(Connector::get().getFd(this->_getOpenDeviceName()), msg_buffer, msg_size);
+        void _handleConnectionState(int connection_state) {
+            switch (connection_state) {
+                case Connector::ConnectionState::OK:
+                    break;
 
-                    if(success < 0) {
-                        to_max.clear();
-                        to_max.push_back(TO_OUTLET_DUMPOUT);
-                        to_max.push_back("Error writing bytes");
-                        _enque_msg_to_max(to_max);
-                        deliverer_to_max.delay(0);
-                    }
-                } else {
-                    std::this_thread::sleep_for(s_chrono::milliseconds(5));
-                }
+                case Connector::ConnectionState::MISSING:
+                    this->_deviceLost("Device disconnected");
+                    break;
+
+                default:
+                    this->_deviceLost("Device connection modified. Disconnecting");
+                    break;
             }
         }
 
-        void _receiveThreadTask() {
-            static std::vector<unsigned char> device_response;
-            static bool                       is_parsing_response      = false;
-            static int                        response_data_byte_count = 0;
-            static int                        respose_length           = 0;
-            static int                        response_index           = 0;
-            static s_chrono::time_point       response_paring_start    = s_chrono::steady_clock::now();
+        void _sendPendingMessages(int fd) {
+            device_message_t  *message;
+            const dmx_frame_t *dmx_frame;
 
+            this->_stats.recordSendQueueDepth(this->_messages_to_device_queue.size());
 
-            if(Connector::get().isConnected(this->_getOpenDeviceName())) {
-                // Test if the device conntion is healthy
-                int         connectionState = Connector::get().connectionState(this->_getOpenDeviceName());
+            // Nothing is written between a failed write and the close: the Max thread clears the queues
+            if(this->_device_lost || !this->_resumeWrite(fd)) {
+                return;
+            }
 
-                if ( connectionState != Connector::ConnectionState::OK) {
-                    switch (connectionState) {
-                        case Connector::ConnectionState::MISSING:
-                            cerr << "Device disconnected" << endl;
-                            break;
+            // Control messages keep their order and are sent before the latest DMX frame. In 'queue'
+            // mode DMX frames are queued with them and paced by the transmit queue as well.
+            while((message = _messages_to_device_queue.front()) != nullptr) {
+                if(message->bytes[1] == MSG_LABEL_SEND_DMX_PACKET && !this->_transmitQueueDrained(fd)) {
+                    return;
+                }
 
-                        default:
-                            cerr << "Device connection modified. Disconnecting" << endl;
-                            break;
-                    }
-                    this->_closeDevice();
-                    is_parsing_response      = false;
-                    response_data_byte_count = 0;
-                    respose_length           = 0;
-                    response_index           = 0;
+                bool is_written = _writeToDevice(fd, message->bytes, message->length, message->enqueued_at);
+
+                _messages_to_device_queue.pop();
+
+                if(!is_written) {
                     return;
                 }
+            }
 
-                // Getting response
-                memset(_serial_in_buffer, 0, SERIAL_IN_BUFF_SIZE);
+            // Until the transmit queue has drained, newer universes replace the frame in the slot
+            if(!_latest_dmx_frame.pending() || !this->_transmitQueueDrained(fd)) {
+                return;
+            }
 
-                std::size_t byte_count = read(Connector::get().getFd(this->_getOpenDeviceName()), _serial_in_buffer, SERIAL_IN_BUFF_SIZE);
+            if((dmx_frame = _latest_dmx_frame.take()) != nullptr) {
+                _writeToDevice(fd, dmx_frame->data(), dmx_frame->size(), _latest_dmx_frame.storedAt());
+            }
+        }
 
-                if(is_parsing_response) {
-                    // Fallback: timeout if response isn't received completly within 200ms
-                    auto elapsed_parsing_time =
-                        s_chrono::duration_cast<s_chrono::milliseconds>(s_chrono::steady_clock::now() - response_paring_start);
+        void _enqueMsgToDevice(std::initializer_list<unsigned char> msg_bytes) {
+            enqueDeviceMessage(this->_messages_to_device_queue, msg_bytes.begin(), msg_bytes.size());
+            this->requestIoSend();
+        }
 
-                    if(elapsed_parsing_time.count() > RESPONSE_TIMEOUT) {
-                        is_parsing_response = false;
-                        response_index      = 0;
-                        if(verbose) {
-                            cwarn << "timeout receiving device response" << endl;
-                        }
-                    }
-                }
+        // Returns false if the driver didn't take the whole message or the write failed. The rest is kept by
+        // _device_writer and written before any other message, onIoSend() is called again to do so.
+        bool _writeToDevice(int fd, const unsigned char *msg_bytes, std::size_t msg_size, s_chrono::steady_clock::time_point enqueued_at) {
+            s_chrono::steady_clock::time_point write_start = s_chrono::steady_clock::now();
+            std::size_t                        byte_count;
+            DeviceWriter::Result               result      = this->_device_writer.write(fd, msg_bytes, msg_size, byte_count);
 
-                if (byte_count > 0) {
-                    if(_serial_in_buffer[0] == MSG_START_CONDITION && !is_parsing_response) {
-                        response_paring_start = s_chrono::steady_clock::now();
-                        is_parsing_response   = true;
-                        response_index        = 0;
-                        device_response.clear();
-                        is_parsing_response      = true;
-                        response_data_byte_count = (int)(((std::uint16_t)(_serial_in_buffer[3]) << 8) | (std::uint16_t)_serial_in_buffer[2]);
-                        respose_length           = response_data_byte_count + 5;
-                    }
+            this->_stats.write_duration.record(s_chrono::steady_clock::now() - write_start);
 
-                    for (std::size_t i = 0; i < byte_count; i++) {
-                        device_response.push_back(_serial_in_buffer[i]);
-                        response_index++;
-                    }
+            if(result != DeviceWriter::Result::FAILED && msg_bytes[1] == MSG_LABEL_SEND_DMX_PACKET) {
+                this->_stats.frames_sent.fetch_add(1, std::memory_order_relaxed);
+                this->_stats.enqueue_to_write.record(write_start - enqueued_at);
+            }
 
-                    if(response_index == respose_length) {
-                        atoms bytes_received;
+            return this->_handleWriteResult(result, byte_count);
+        }
 
-                        is_parsing_response = false;
-                        response_index      = 0;
-                        _processDeviceResponds(device_response);
-                    }
+        // Continues a message the driver didn't take completely. Returns false while it still isn't written or if the write failed.
+        bool _resumeWrite(int fd) {
+            std::size_t          byte_count;
+            DeviceWriter::Result result = this->_device_writer.resume(fd, byte_count);
+
+            return this->_handleWriteResult(result, byte_count);
+        }
+
+        bool _handleWriteResult(DeviceWriter::Result result, std::size_t byte_count) {
+            this->_stats.bytes_written.fetch_add((std::uint64_t)byte_count, std::memory_order_relaxed);
+
+            switch (result) {
+                case DeviceWriter::Result::COMPLETE:
+                    return true;
+
+                case DeviceWriter::Result::BLOCKED:
+                    this->_stats.write_stalls.fetch_add(1, std::memory_order_relaxed);
+                    this->requestIoSendAt(s_chrono::steady_clock::now() + s_chrono::milliseconds(TX_DRAIN_POLL_INTERVAL));
+                    return false;
+
+                case DeviceWriter::Result::FAILED:
+                    break;
+            }
+
+            this->_stats.write_errors.fetch_add(1, std::memory_order_relaxed);
+            this->_connection->reportIoError(this->_device_writer.errorNumber());
+
+            if(this->_connection->state() != Connector::ConnectionState::OK) {
+                this->_handleConnectionState(this->_connection->state());
+                return false;
+            }
+
+            // The message is dropped, the next ones are tried again later instead of in a burst of errors
+            this->_enqueMaxEvent(TO_OUTLET_DUMPOUT, MaxEventType::TEXT, {}, "Error writing bytes");
+            this->requestIoSendAt(s_chrono::steady_clock::now() + s_chrono::milliseconds(TX_DRAIN_POLL_INTERVAL));
+            return false;
+        }
+
+        // Frames are only written once the previous ones have left the driver's transmit queue, so they
+        // can't pile up there: in 'latest' mode the bytes on the wire always come from the newest universe,
+        // in 'queue' mode frames wait in order. Asks for onIoSend() to be called again while the queue drains.
+        bool _transmitQueueDrained(int fd) {
+            if(DeviceWriter::transmitQueued(fd) == 0) {
+                return true;
+            }
+
+            this->requestIoSendAt(s_chrono::steady_clock::now() + s_chrono::milliseconds(TX_DRAIN_POLL_INTERVAL));
+            return false;
+        }
+
+        void _receiveFromDevice(int fd) {
+            ssize_t byte_count = read(fd, _serial_in_buffer, SERIAL_IN_BUFF_SIZE);
+
+            if(byte_count <= 0) {
+                // poll() reported data, so nothing to read means the device is gone
+                if(byte_count == 0) {
+                    this->_connection->reportEndOfFile();
+                } else {
+                    this->_connection->reportIoError(errno);
                 }
+
+                this->_handleConnectionState(this->_connection->state());
+                return;
             }
+
+            this->_device_parser.parse(_serial_in_buffer, (std::size_t)byte_count, [this](const unsigned char *message, std::size_t length) {
+                this->_processDeviceResponds(message, length);
+            });
         }
 
-        void _processDeviceResponds(const std::vector<unsigned char> received_bytes) {
-            atoms                             response_message;
-            int                               breaktime_val;
-            int                               mabtime_val;
-            int                               refresh_val;
-            char                              firmware_version[8];
-            char                              serial_number_string[10];
-            static std::vector<unsigned char> last_dmx_package;
-            std::vector<unsigned char>        current_dmx_package;
+        void _processDeviceResponds(const unsigned char *received_bytes, std::size_t length) {
+            int   breaktime_val;
+            int   mabtime_val;
+            int   refresh_val;
+            char  firmware_version[8];
+            char  serial_number_string[10];
 
             switch (received_bytes[1]) {
                 case MSG_LABEL_GET_WIDGET_PARAMETRES:
+                    // firmware version, break time, MAB time and refresh rate
+                    if(length < 10) {
+                        this->_enqueMaxEvent(TO_MAX_CONSOLE_ERROR, MaxEventType::TEXT, {}, "error parsing device response.");
+                        return;
+                    }
 
                     breaktime_val = (int)((float)received_bytes[6] * 10.67f);
                     mabtime_val   = (int)((float)received_bytes[7] * 10.67f);
                     refresh_val   = (int)received_bytes[8];
 
                     snprintf(firmware_version, 8, "%d.%d", received_bytes[5], received_bytes[4] );
-                    response_message.push_back(TO_OUTLET_DUMPOUT);
-                    response_message.push_back("firmware");
-                    response_message.push_back(std::string(firmware_version));
-                    _enque_msg_to_max(response_message);
-                    deliverer_to_max.delay(0);
-
-                    response_message.clear();
-                    response_message.push_back(TO_OUTLET_DUMPOUT);
-                    response_message.push_back("breaktime");
-                    response_message.push_back(breaktime_val);
-                    _enque_msg_to_max(response_message);
-                    deliverer_to_max.delay(0);
-
-                    response_message.clear();
-                    response_message.push_back(TO_OUTLET_DUMPOUT);
-                    response_message.push_back("mabtime");
-                    response_message.push_back(mabtime_val);
-                    _enque_msg_to_max(response_message);
-                    deliverer_to_max.delay(0);
-
-                    response_message.clear();
-                    response_message.push_back(TO_OUTLET_DUMPOUT);
-                    response_message.push_back("refresh");
-                    response_message.push_back(refresh_val);
-                    _enque_msg_to_max(response_message);
-                    deliverer_to_max.delay(0);
+                    this->_enqueMaxEvent(TO_OUTLET_DUMPOUT, MaxEventType::DEVICE_SETTINGS, { breaktime_val, mabtime_val, refresh_val }, firmware_version);
                     return;
 
                 case MSG_LABEL_GET_WIDGET_SERIAL_NUMBER:
+                    if(length < 9) {
+                        this->_enqueMaxEvent(TO_MAX_CONSOLE_ERROR, MaxEventType::TEXT, {}, "error parsing device response.");
+                        return;
+                    }
+
                     snprintf(serial_number_string,10,"%02X%02X%02X%02X",
                              received_bytes[7], received_bytes[6],
                              received_bytes[5], received_bytes[4]
                              );
-                    response_message.push_back(TO_OUTLET_DUMPOUT);
-                    response_message.push_back("serialnumber");
-                    response_message.push_back(serial_number_string);
-                    _enque_msg_to_max(response_message);
-                    deliverer_to_max.delay(0);
+                    this->_enqueMaxEvent(TO_OUTLET_DUMPOUT, MaxEventType::SERIAL_NUMBER, {}, serial_number_string);
                     return;
 
                 case MSG_LABEL_RECEIVED_DMX_PACKET:
-                    response_message.clear();
-                    current_dmx_package.clear();
+                case MSG_LABEL_RECEIVED_DMX_PACKET_CHANGE:
+                    this->_stats.frames_received.fetch_add(1, std::memory_order_relaxed);
 
-                    if(received_bytes[4] != 0) {
-                        response_message.push_back(TO_MAX_CONSOLE_WARN);
-                        response_message.push_back("corrupt DMX package received.");
-                    } else {
-                        int         data_byte_count = (int)(((std::uint16_t)(received_bytes[3]) << 8) | (std::uint16_t)received_bytes[2]);
-                        std::string out_format      = outformat.get();
-                        std::string out_mode        = outmode.get();
+                    // Copied once into a pooled slot, decoded and sent out on the Max thread
+                    if(!enqueDeviceInput(this->_dmx_input_queue, received_bytes, length) && verbose) {
+                        this->_enqueMaxEvent(TO_MAX_CONSOLE_WARN, MaxEventType::TEXT, {}, "DMX input dropped: receive queue full.");
+                    }
 
-                        response_message.push_back(TO_OUTLET_1);
-                        current_dmx_package.clear();
+                    this->_scheduleDelivery();
+                    return;
 
-                        std::size_t i = (out_format == "list") ? 2 : 1;
+                default:
+                    this->_enqueMaxEvent(TO_MAX_CONSOLE_ERROR, MaxEventType::TEXT, {}, "error parsing device response.");
+                    return;
+            }
+        }
 
-                        for (; i < data_byte_count; i++) {
-                            current_dmx_package.push_back(received_bytes[i + 4]);
+        // Decodes received DMX on the Max thread. Output lists are built in _dmx_output, whose
+        // capacity is kept, so sending DMX out the first outlet doesn't allocate.
+        void _processDmxInput(const unsigned char *received_bytes, std::size_t length) {
+            if(this->_reset_dmx_input.exchange(false)) {
+                memset(this->_dmx_input, 0, DMX_SLOTS);
+                this->_dmx_input_count = 0;
+            }
 
-                            if(out_format == "list") {
-                                response_message.push_back(i - 1);
-                                response_message.push_back(received_bytes[i + 4]);
-                            } else {
-                                response_message.push_back(received_bytes[i + 4]);
-                            }
-                        }
+            if(received_bytes[1] == MSG_LABEL_RECEIVED_DMX_PACKET) {
+                this->_processDmxPacket(received_bytes, length);
+            } else {
+                this->_processDmxChange(received_bytes, length);
+            }
+        }
+
+        // DMX packet: [status, start code, channels...]
+        void _processDmxPacket(const unsigned char *received_bytes, std::size_t length) {
+            const unsigned char *slots           = received_bytes + 5;
+            std::size_t          data_byte_count = length - 5;
+            std::size_t          slot_count;
+            std::string          out_format      = outformat.get();
+            std::string          out_mode        = outmode.get();
+
+            if(data_byte_count < 2 || received_bytes[4] != 0) {
+                cwarn << "corrupt DMX package received." << endl;
+                return;
+            }
+
+            slot_count = std::min<std::size_t>(data_byte_count - 1, DMX_SLOTS);
+
+            if(out_format == "delta") {
+                this->_processDmxDelta(slots, slot_count);
+                return;
+            }
+
+            if(
+                out_mode != "always"
+                && slot_count == this->_dmx_input_count
+                && memcmp(slots, this->_dmx_input, slot_count) == 0
+                ) {
+                return;
+            }
+
+            memcpy(this->_dmx_input, slots, slot_count);
+            this->_dmx_input_count = slot_count;
+
+            if(out_format == "buffer" || out_format == "matrix") {
+                this->_writeDmxInput(out_format);
+                return;
+            }
+
+            this->_dmx_output.clear();
+
+            if(out_format == "list") {
+                for(std::size_t i = 1; i < slot_count; i++) {
+                    this->_dmx_output.push_back(i);
+                    this->_dmx_output.push_back(slots[i]);
+                }
+            } else {
+                for(std::size_t i = 0; i < slot_count; i++) {
+                    this->_dmx_output.push_back(slots[i]);
+                }
+            }
+
+            output_1.send(this->_dmx_output);
+        }
+
+        // 'delta' output format: only channels that differ from the previous frame are sent out and
+        // nothing at all is built when the frame didn't change. 'slots' starts with the DMX start code.
+        void _processDmxDelta(const unsigned char *slots, std::size_t slot_count) {
+            this->_dmx_output.clear();
+
+            DmxDiff::apply(slots + 1, this->_dmx_input + 1, slot_count - 1, [this](std::size_t index, unsigned char value) {
+                this->_dmx_output.push_back(index + 1);
+                this->_dmx_output.push_back(value);
+            });
+
+            this->_dmx_input[0]    = slots[0];
+            this->_dmx_input_count = slot_count;
+
+            if(!this->_dmx_output.empty()) {
+                output_1.send(this->_dmx_output);
+            }
+        }
+
+        // Change of state packet: [start block, 5 bytes changed slot bit array, changed slot values...]
+        // Bit n of the array stands for slot 'start block * 8 + n', slot 0 being the DMX start code.
+        void _processDmxChange(const unsigned char *received_bytes, std::size_t length) {
+            const unsigned char *data            = received_bytes + 4;
+            std::size_t          data_byte_count = length - 5;
+            std::size_t          first_slot      = (std::size_t)data[0] * DMX_CHANGE_BLOCK_SIZE;
+            std::size_t          value_index     = 1 + DMX_CHANGE_MASK_BYTES;
+            std::string          out_format      = outformat.get();
+            std::string          out_mode        = outmode.get();
+            bool                 has_changed     = false;
+
+            if(data_byte_count < 1 + DMX_CHANGE_MASK_BYTES) {
+                cerr << "error parsing device response." << endl;
+                return;
+            }
+
+            this->_dmx_output.clear();
+
+            for(std::size_t bit = 0; bit < DMX_CHANGE_MASK_BYTES * 8; bit++) {
+                std::size_t slot = first_slot + bit;
+
+                if((data[1 + bit / 8] & (1 << (bit % 8))) == 0) {
+                    continue;
+                }
+
+                if(value_index >= data_byte_count || slot >= DMX_SLOTS) {
+                    cwarn << "corrupt DMX change packet received." << endl;
+                    return;
+                }
+
+                unsigned char value = data[value_index++];
+
+                if(this->_dmx_input[slot] == value && out_mode != "always") {
+                    continue;
+                }
+
+                this->_dmx_input[slot]  = value;
+                this->_dmx_input_count  = DMX_SLOTS;
+                has_changed             = true;
+
+                if((out_format == "list" || out_format == "delta") && slot > 0) {
+                    this->_dmx_output.push_back(slot);
+                    this->_dmx_output.push_back(value);
+                }
+            }
+
+            if(!has_changed) {
+                return;
+            }
+
+            if(out_format == "buffer" || out_format == "matrix") {
+                this->_writeDmxInput(out_format);
+                return;
+            }
+
+            // Raw output is always the complete universe
+            if(out_format == "raw") {
+                for(std::size_t i = 0; i < DMX_SLOTS; i++) {
+                    this->_dmx_output.push_back(this->_dmx_input[i]);
+                }
+            }
+
+            if(!this->_dmx_output.empty()) {
+                output_1.send(this->_dmx_output);
+            }
+        }
+
+        // 'buffer' and 'matrix' output formats: channels 1 - 512 of the input universe are written to the
+        // buffer~ or jit.matrix named by 'outname' and only a bang is sent out the first outlet.
+        void _writeDmxInput(const std::string &out_format) {
+            bool is_written = out_format == "buffer" ? this->_writeDmxInputToBuffer() : this->_writeDmxInputToMatrix();
+
+            if(!is_written) {
+                if(verbose) {
+                    cwarn << "no " << (out_format == "buffer" ? "buffer~" : "1 plane char jit.matrix") << " named '" << std::string(outname.get()) << "'" << endl;
+                }
+
+                return;
+            }
+
+            output_1.send("bang");
+        }
+
+        bool _writeDmxInputToBuffer() {
+            buffer_lock<> target_buffer(this->_output_buffer);
+
+            if(!target_buffer.valid()) {
+                return false;
+            }
+
+            std::size_t frame_count = std::min<std::size_t>(target_buffer.frame_count(), 512);
+
+            for(std::size_t i = 0; i < frame_count; i++) {
+                target_buffer.lookup(i, 0) = (float)this->_dmx_input[i + 1];
+            }
+
+            target_buffer.dirty();
+            return true;
+        }
 
-                        if(current_dmx_package != last_dmx_package || out_mode == "always") {
-                            last_dmx_package = current_dmx_package;
-                            _enque_msg_to_max(response_message);
-                            deliverer_to_max.delay(0);
+        bool _writeDmxInputToMatrix() {
+            c74::max::t_jit_matrix_info matrix_info;
+            char                        *matrix_data = nullptr;
+            void                        *matrix      = c74::max::jit_object_findregistered(outname.get());
+
+            if(matrix == nullptr || c74::max::jit_object_method(matrix, c74::max::_jit_sym_class_jit_matrix) == nullptr) {
+                return false;
+            }
+
+            long lock_state = (long)c74::max::jit_object_method(matrix, c74::max::_jit_sym_lock, 1);
+
+            c74::max::jit_object_method(matrix, c74::max::_jit_sym_getinfo, &matrix_info);
+            c74::max::jit_object_method(matrix, c74::max::_jit_sym_getdata, &matrix_data);
+
+            bool is_writable = matrix_data != nullptr && matrix_info.type == c74::max::_jit_sym_char && matrix_info.dimcount >= 1;
+
+            if(is_writable) {
+                std::size_t channel_count = std::min<std::size_t>(matrix_info.dim[0], 512);
+
+                // First row, first plane
+                if(matrix_info.dimstride[0] == 1) {
+                    memcpy(matrix_data, this->_dmx_input + 1, channel_count);
+                } else {
+                    for(std::size_t i = 0; i < channel_count; i++) {
+                        matrix_data[i * matrix_info.dimstride[0]] = (char)this->_dmx_input[i + 1];
+                    }
+                }
+            }
+
+            c74::max::jit_object_method(matrix, c74::max::_jit_sym_lock, lock_state);
+            return is_writable;
+        }
+
+        // Sends the universe after channels up to 'highest_channel' have been set
+        void _universeChanged(int highest_channel) {
+            if(highest_channel > this->_highest_channel.load(std::memory_order_relaxed)) {
+                this->_highest_channel.store(highest_channel, std::memory_order_relaxed);
+            }
+
+            if(!this->_blackout) {
+                this->_enqueMsgSendDmxPpacket(this->_dmx_universe);
+            }
+        }
+
+        // Copies the first row of the jit.matrix 'matrix_name' into the universe.
+        // Returns the number of channels set, 0 if there is no matrix of that name.
+        int _readUniverseFromMatrix(const symbol &matrix_name) {
+            c74::max::t_jit_matrix_info matrix_info;
+            char                        *matrix_data   = nullptr;
+            std::size_t                 channel_count = 0;
+            void                        *matrix        = c74::max::jit_object_findregistered(matrix_name);
+
+            if(matrix == nullptr || c74::max::jit_object_method(matrix, c74::max::_jit_sym_class_jit_matrix) == nullptr) {
+                return 0;
+            }
+
+            long lock_state = (long)c74::max::jit_object_method(matrix, c74::max::_jit_sym_lock, 1);
+
+            c74::max::jit_object_method(matrix, c74::max::_jit_sym_getinfo, &matrix_info);
+            c74::max::jit_object_method(matrix, c74::max::_jit_sym_getdata, &matrix_data);
+
+            if(matrix_data != nullptr && matrix_info.dimcount >= 1) {
+                long stride = matrix_info.dimstride[0];
+
+                channel_count = std::min<std::size_t>(matrix_info.dim[0], 512);
+
+                if(matrix_info.type == c74::max::_jit_sym_char) {
+                    if(stride == 1) {
+                        memcpy(this->_dmx_universe, matrix_data, channel_count);
+                    } else {
+                        for(std::size_t i = 0; i < channel_count; i++) {
+                            this->_dmx_universe[i] = (unsigned char)matrix_data[i * stride];
                         }
                     }
+                } else if(matrix_info.type == c74::max::_jit_sym_long) {
+                    std::int32_t values[512];
 
-                    return;
+                    for(std::size_t i = 0; i < channel_count; i++) {
+                        memcpy(&values[i], matrix_data + i * stride, sizeof(std::int32_t));
+                    }
 
-                default:
-                    cerr << "error parsing device response." << endl;
-                    return;
+                    DmxConvert::fromInts(values, this->_dmx_universe, channel_count);
+                } else if(matrix_info.type == c74::max::_jit_sym_float32) {
+                    float values[512];
+
+                    for(std::size_t i = 0; i < channel_count; i++) {
+                        memcpy(&values[i], matrix_data + i * stride, sizeof(float));
+                    }
+
+                    DmxConvert::fromFloats(values, this->_dmx_universe, channel_count, 255.f);
+                } else if(matrix_info.type == c74::max::_jit_sym_float64) {
+                    float values[512];
+
+                    for(std::size_t i = 0; i < channel_count; i++) {
+                        double value;
+
+                        memcpy(&value, matrix_data + i * stride, sizeof(double));
+                        values[i] = (float)value;
+                    }
+
+                    DmxConvert::fromFloats(values, this->_dmx_universe, channel_count, 255.f);
+                } else {
+                    channel_count = 0;
+                }
             }
+
+            c74::max::jit_object_method(matrix, c74::max::_jit_sym_lock, lock_state);
+            return (int)channel_count;
+        }
+
+        // Channels to send: the 'channels' attribute or, if it is 0, the highest channel used so far
+        std::size_t _frameChannelCount() {
+            int channel_count = channels;
+
+            return (std::size_t)(channel_count > 0 ? channel_count : this->_highest_channel.load(std::memory_order_relaxed));
         }
 
         void _enqueMsgSendDmxPpacket(const unsigned char (&universe)[512]) {
-            std::uint16_t              channel_count       = 512;
-            std::uint16_t              data_byte_count     = channel_count + 1;
-            unsigned char              data_byte_count_lsb = (unsigned char)(data_byte_count & 0x00FF);
-            unsigned char              data_byte_count_msb = (unsigned char)((data_byte_count & 0xFF00) >> 8);
+            std::string                        send_mode     = sendmode.get();
+            std::size_t                        channel_count = this->_frameChannelCount();
+            s_chrono::steady_clock::time_point now           = s_chrono::steady_clock::now();
 
-            std::vector<unsigned char> msg_send_dmx {
-                MSG_START_CONDITION,
-                MSG_LABEL_SEND_DMX_PACKET,
-                data_byte_count_lsb, data_byte_count_msb,
-                0x00 // Start Code: USITT Default Null Start Code for Dimmers per DMX512 & DMX512/1990
-            };
+            if(send_mode == "latest") {
+                // The slot takes one producer at a time, messages may come from the main and the scheduler thread
+                this->_frame_store_lock.lock();
+
+                if(this->_latest_dmx_frame.store(universe, channel_count, now)) {
+                    this->_stats.frames_replaced.fetch_add(1, std::memory_order_relaxed);
+                }
 
-            for(std::uint16_t i = 0; i < channel_count; i++) {
-                msg_send_dmx.push_back(universe[i]);
+                this->_frame_store_lock.unlock();
+            } else if(!this->_messages_to_device_queue.tryPush([&universe, channel_count, now](device_message_t &message) {
+                message.enqueued_at = now;
+                message.length      = (std::uint16_t)dmx_frame_t::encode(message.bytes, universe, channel_count);
+            })) {
+                this->_stats.frames_overflowed.fetch_add(1, std::memory_order_relaxed);
             }
 
-            msg_send_dmx.push_back(MSG_END_CONDITION);
-            this->_messages_to_device_queue.push(msg_send_dmx);
+            this->requestIoSend();
         }
 
     public:
@@ -337,6 +760,8 @@ class dmxusbpro : public object<dmxusbpro>
         dmxusbpro(const atoms& args = {}) {
             memset(this->_dmx_universe, 0, 512);
             memset(this->_dmx_blackout, 0, 512);
+            memset(this->_dmx_input, 0, DMX_SLOTS);
+            this->_dmx_output.reserve(2 * 512);
         }
 
         ~dmxusbpro() {
@@ -350,57 +775,37 @@ class dmxusbpro : public object<dmxusbpro>
         MIN_RELATED         { "jam.dmxusbpro~, serial"};
 
         inlet<> input_1    { this, "(anything) Control Messages", "anything" };
-        outlet<> output_1   { this, "(list) DMX Output <startcode> <channel> <value>", "list" };
+        outlet<> output_1   { this, "(list/bang) DMX Output <startcode> <channel> <value>", "list" };
         outlet<> output_2   { this, "(int) State of Connection", "int" };
         outlet<> output_3   { this, "(anything) Connect to umenu" };
         outlet<> output_dumpout   { this, "dumpout"};
 
-        timer<> deliverer_to_max {
+        timer<timer_options::defer_delivery> device_closer {
             this, MIN_FUNCTION {
-                atoms queue_data;
-
-                while (_dequeue_msg_to_max(queue_data)) {
-                    int   destination = queue_data[0];
-                    atoms message;
-
-                    for(std::size_t i = 1; i < queue_data.size(); i++) {
-                        message.push_back(queue_data[i]);
-                    }
-
-                    switch (destination) {
-                        case TO_OUTLET_1:
-                            output_1.send(message);
-                            break;
-
-                        case TO_OUTLET_2:
-                            output_2.send(message);
-                            break;
-
-                        case TO_OUTLET_3:
-                            output_3.send(message);
-                            break;
-
-                        case TO_OUTLET_DUMPOUT:
-                            output_dumpout.send(message);
-                            break;
-
-                        case TO_MAX_CONSOLE:
+                this->_closeDevice();
+                return {};
+            }
+        };
 
-                            for(std::size_t i = 0; i < message.size(); i++) {
-                                cout << message[i] << endl;
-                            }
+        timer<> deliverer_to_max {
+            this, MIN_FUNCTION {
+                max_event_t *event;
 
-                            break;
+                // Cleared first, so events queued from now on schedule another delivery
+                this->_delivery_scheduled.store(false, std::memory_order_release);
 
-                        case TO_MAX_CONSOLE_WARN:
+                while ((event = this->_max_events.front()) != nullptr) {
+                    this->_deliverMaxEvent(*event);
+                    this->_max_events.pop();
+                }
 
-                            for(std::size_t i = 0; i < message.size(); i++) {
-                                cout << message[i] << endl;
-                            }
+                device_input_t *dmx_input;
 
-                            break;
-                    }
+                while ((dmx_input = this->_dmx_input_queue.front()) != nullptr) {
+                    this->_processDmxInput(dmx_input->bytes, dmx_input->length);
+                    this->_dmx_input_queue.pop();
                 }
+
                 return {};
             }
         };
@@ -426,7 +831,7 @@ class dmxusbpro : public object<dmxusbpro>
             range {9600, 256000},
             readonly {false},
             setter { MIN_FUNCTION {
-                         if(Connector::get().isConnected(this->_getOpenDeviceName())) {
+                         if(this->_is_connected) {
                              cerr << "baudrate has changed. closing the connection." << endl;
                              this->_closeDevice();
                          }
@@ -436,11 +841,51 @@ class dmxusbpro : public object<dmxusbpro>
             }
         };
 
+        attribute<int, threadsafe::no, limit::clamp, allow_repetitions::no> healthcheck {
+            this, "healthcheck", HEALTH_CHECK_INTERVAL,
+            title { "Health check interval" },
+            description { "Interval in ms at which the settings of the serial connection are checked for modifications by other applications. Default: 1000. 0 disables the check.<br />Unplugging the device is detected independently of this interval." },
+            range { 0, 60000 },
+            setter { MIN_FUNCTION {
+                         if(this->_connection) {
+                             this->_connection->setHealthCheckInterval(args[0]);
+                         }
+
+                         return args;
+                     }
+            }
+        };
+
+        attribute<symbol, threadsafe::no, limit::none, allow_repetitions::no> sendmode {
+            this, "sendmode", "latest",
+            title { "DMX send mode" },
+            description { "If set to 'latest' (default) DMX frames that have not been written to the device yet are replaced by newer ones, so the device always receives the latest universe. If set to 'queue' every DMX frame is written to the device in order.<br />Control messages like <i>devicesettings</i>, <i>deviceserial</i> and <i>receive</i> are always sent in order." },
+            range {"latest", "queue"}
+        };
+
+        attribute<int, threadsafe::no, limit::clamp, allow_repetitions::no> channels {
+            this, "channels", 512,
+            title { "DMX channel count" },
+            description { "Number of DMX channels sent to the device, 512 by default. A DMX frame takes about 44 microseconds per channel on the wire, so sending only the channels in use raises the refresh rate of the DMX output. If set to 0 frames end at the highest channel that has been set so far. Frames carry at least 24 channels." },
+            range {0, 512}
+        };
+
         attribute<symbol, threadsafe::no, limit::none, allow_repetitions::no> outformat {
             this, "outformat", "list",
             title { "DMX data output format" },
-            description { "DMX data format sent to first outlet. If set to 'list' (default) a list of pairs of <i>DMX Channel</i> and <i>DMX Value</i> will be send out. If set to 'raw' outputs the raw bytes of received DMX data:<br />First byte: Status code. Following Bytes: DMX values.<br />" },
-            range {"raw", "list"}
+            description { "DMX data format sent to first outlet. If set to 'list' (default) a list of pairs of <i>DMX Channel</i> and <i>DMX Value</i> will be send out. If set to 'raw' outputs the raw bytes of received DMX data:<br />First byte: Status code. Following Bytes: DMX values.<br />If set to 'delta' only pairs of <i>DMX Channel</i> and <i>DMX Value</i> of channels that have changed since the last received DMX package will be sent out, regardless of <i>outmode</i>.<br />If set to 'buffer' or 'matrix' received DMX data is written to the buffer~ or jit.matrix named by <i>outname</i> and a bang is sent out." },
+            range {"raw", "list", "delta", "buffer", "matrix"}
+        };
+
+        attribute<symbol, threadsafe::no, limit::none, allow_repetitions::no> outname {
+            this, "outname", "",
+            title { "DMX data output buffer~ or jit.matrix" },
+            description { "Name of the buffer~ (<i>outformat</i> 'buffer') or jit.matrix (<i>outformat</i> 'matrix') received DMX data is written to. Sample n of the first buffer~ channel or cell n of a char jit.matrix holds the value (0-255) of DMX channel n + 1." },
+            setter { MIN_FUNCTION {
+                         this->_output_buffer.set(args[0]);
+                         return args;
+                     }
+            }
         };
 
         attribute<symbol, threadsafe::no, limit::none, allow_repetitions::no> outmode {
@@ -450,12 +895,19 @@ class dmxusbpro : public object<dmxusbpro>
             range {"onchange", "always"}
         };
 
+        attribute<symbol, threadsafe::no, limit::none, allow_repetitions::no> inmode {
+            this, "inmode", "full",
+            title { "DMX receive mode" },
+            description { "Set by the message <i>receive</i>. If set to 'full' (default) the device sends every DMX packet it receives. If set to 'change' the device only reports the channels that have changed, which needs much less bandwidth when monitoring a console. With <i>outformat</i> 'list' or 'delta' only changed channels are sent out the first outlet." },
+            range {"full", "change"}
+        };
+
         message<threadsafe::yes> receive {
             this, "receive",
             "Set device to receive DMX messages.<br /><b>Note</b>: Sending a list of DMX values or sending the message deviceserial will set the device into send mode again.",
             MIN_FUNCTION {
 
-                if(!Connector::get().isConnected(this->_getOpenDeviceName())) {
+                if(!this->_is_connected) {
                     if(verbose) {
                         cerr << "Can't set receive mode, not connected." << endl;
                     }
@@ -463,10 +915,16 @@ class dmxusbpro : public object<dmxusbpro>
                     return {};
                 }
 
-                this->_messages_to_device_queue.push(std::vector<unsigned char> {
+                // Change of state packets only update channels, start from a dark universe
+                bool on_change = inmode.get() == symbol("change");
+
+                this->_reset_dmx_input = true;
+
+                this->_enqueMsgToDevice({
                 MSG_START_CONDITION,
                 MSG_LABEL_RECEIVE_DMX,
-                0x01, 0x00, 0x00,
+                0x01, 0x00,
+                (unsigned char)(on_change ? 0x01 : 0x00),
                 MSG_END_CONDITION
             });
 
@@ -514,79 +972,33 @@ class dmxusbpro : public object<dmxusbpro>
 
                 this->_closeDevice();
 
-                int         set_baudrate = baudrate;
-                int         open_success = Connector::get().openSerialPort(device_name, set_baudrate);
-
-                if(open_success == -1) {
-                    cerr << "Error opening device" << endl;
+                if(Connector::get().isConnected(device_name)) {
+                    cerr << "'" << device_name << "' already opened by another instance." << endl;
                     return {};
                 }
 
-                if(open_success == -2) {
-                    cerr << "'" << device_name << "' already opened by another instance." << endl;
+                int                     set_baudrate = baudrate;
+                Connector::connection_t connection   = Connector::get().openSerialPort(device_name, set_baudrate);
+
+                if(!connection) {
+                    cerr << "Error opening device" << endl;
                     return {};
                 }
 
                 this->_setOpenDeviceName(device_name);
                 this->_connections[device_name] = 1;
-                atoms       connection_state;
-                connection_state.push_back(TO_OUTLET_2);
-                connection_state.push_back(1);
-                _enque_msg_to_max(connection_state);
-                deliverer_to_max.delay(0);
-
-                this->_io_threads_continue = true;
-                std::this_thread::sleep_for(s_chrono::milliseconds(10));
-
-                this->_receive_thread = std::thread([this]()
-            {
-                atoms msg_to_console;
-
-                if (verbose) {
-                    msg_to_console.push_back(TO_MAX_CONSOLE);
-                    msg_to_console.push_back("starting receive thread");
-                    _enque_msg_to_max(msg_to_console);
-                    deliverer_to_max.delay(0);
-                }
-
-                while(_io_threads_continue) {
-                    _receiveThreadTask();
-                }
-
-                if (verbose) {
-                    msg_to_console.clear();
-                    msg_to_console.push_back(TO_MAX_CONSOLE);
-                    msg_to_console.push_back("stopping receive thread");
-                    _enque_msg_to_max(msg_to_console);
-                    deliverer_to_max.delay(0);
-                }
-            });
-                this->_receive_thread.detach();
-
-                this->_send_thread = std::thread([this]()
-            {
-                atoms msg_to_console;
-
-                if (verbose) {
-                    msg_to_console.push_back(TO_MAX_CONSOLE);
-                    msg_to_console.push_back("starting send thread");
-                    _enque_msg_to_max(msg_to_console);
-                    deliverer_to_max.delay(0);
-                }
-
-                while(_io_threads_continue) {
-                    _sendThreadTask();
-                }
-
-                if (verbose) {
-                    msg_to_console.clear();
-                    msg_to_console.push_back(TO_MAX_CONSOLE);
-                    msg_to_console.push_back("stopping send thread");
-                    _enque_msg_to_max(msg_to_console);
-                    deliverer_to_max.delay(0);
-                }
-            });
-                this->_send_thread.detach();
+                this->_enqueMaxEvent(TO_OUTLET_2, MaxEventType::CONNECTION_STATE, { 1 });
+
+                // Messages left from a previous connection must not be sent to this device
+                this->_messages_to_device_queue.clear();
+                this->_latest_dmx_frame.clear();
+                this->_device_parser.reset();
+                this->_device_writer.clear();
+                this->_device_lost  = false;
+                this->_connection   = connection;
+                this->_connection->setHealthCheckInterval(healthcheck);
+                this->_is_connected = true;
+                Connector::get().reactor().add(this, connection->fd());
                 return {};
             }
         };
@@ -606,7 +1018,7 @@ class dmxusbpro : public object<dmxusbpro>
                 out_atoms.push_back("(Select Interface)");
                 output_3.send(out_atoms);
 
-                std::vector<std::string> device_names = Connector::get().getDeviceNames(verbose, true);
+                std::vector<std::string> device_names = Connector::get().getDeviceNames(verbose);
 
                 for (auto& device_name : device_names) {
                     atoms device_list;
@@ -622,7 +1034,7 @@ class dmxusbpro : public object<dmxusbpro>
         message<threadsafe::yes> list {
             this, "list", "An even number of integers, indicating pairs of <i>DMX Channel</i> and <i>DMX Value</i>.<br/>Sets the specified channels to the specified values.",
             MIN_FUNCTION {
-                if(!Connector::get().isConnected(this->_getOpenDeviceName())) {
+                if(!this->_is_connected) {
                     return{};
                 }
 
@@ -645,20 +1057,94 @@ class dmxusbpro : public object<dmxusbpro>
                     return {};
                 }
 
-                for(std::size_t i = 0; i < args.size(); i = i + 2) {
-                    int dmx_channel = args[i];
-                    int dmx_val     = args[i + 1];
-                    dmx_channel = std::min(512, std::max(1, dmx_channel));
-                    dmx_val     = std::min(255, std::max(0, dmx_val));
+                this->_universeChanged(UniverseUpdate::setPairs(this->_dmx_universe, args, args.size()));
+                return {};
+            }
+        };
+
+        message<threadsafe::yes> setrange {
+            this, "setrange", "Sets consecutive channels. <p>Arguments: first DMX channel[int], DMX values[int]...</p>",
+            MIN_FUNCTION {
+                std::int32_t dmx_values[512];
 
-                    // setting the channel in the universe
-                    this->_dmx_universe[dmx_channel - 1] = (unsigned char)dmx_val;
+                if(!this->_is_connected) {
+                    return{};
                 }
 
-                if(!this->_blackout) {
-                    this->_enqueMsgSendDmxPpacket(this->_dmx_universe);
+                if(args.size() < 2 || args[0].type() != message_type::int_argument) {
+                    cerr << "Invalid arguments for message setrange. Expecting first DMX Channel followed by DMX Values (0-255)." << endl;
+                    return {};
                 }
 
+                int         first_channel = std::min(512, std::max(1, (int)args[0]));
+                std::size_t value_count   = std::min<std::size_t>(args.size() - 1, 512 - (first_channel - 1));
+
+                for(std::size_t i = 0; i < value_count; i++) {
+                    if(args[i + 1].type() != message_type::int_argument && args[i + 1].type() != message_type::float_argument) {
+                        cerr << "Invalid arument type. Expeting list on integers." << endl;
+                        return {};
+                    }
+
+                    dmx_values[i] = (int)args[i + 1];
+                }
+
+                DmxConvert::fromInts(dmx_values, this->_dmx_universe + first_channel - 1, value_count);
+                this->_universeChanged(first_channel - 1 + (int)value_count);
+                return {};
+            }
+        };
+
+        message<threadsafe::no> jit_matrix {
+            this, "jit_matrix", "Sets channels from the first row of a jit.matrix: cell n holds the value of DMX channel n + 1. Values of char and long matrices are taken as they are (0-255), values of float matrices are scaled from 0-1.",
+            MIN_FUNCTION {
+                if(!this->_is_connected || args.empty()) {
+                    return{};
+                }
+
+                int highest_channel = this->_readUniverseFromMatrix(args[0]);
+
+                if(highest_channel == 0) {
+                    cerr << "Can't read DMX values from jit.matrix '" << std::string(args[0]) << "'" << endl;
+                    return {};
+                }
+
+                this->_universeChanged(highest_channel);
+                return {};
+            }
+        };
+
+        message<threadsafe::no> buffer {
+            this, "buffer", "Sets channels from a buffer~: sample n of the first buffer~ channel holds the value (0-255) of DMX channel n + 1. <p>Argument: buffer~ name[symbol]</p>",
+            MIN_FUNCTION {
+                if(!this->_is_connected || args.empty()) {
+                    return{};
+                }
+
+                this->_input_buffer.set(args[0]);
+
+                buffer_lock<> source_buffer(this->_input_buffer);
+
+                if(!source_buffer.valid()) {
+                    cerr << "Can't read DMX values from buffer~ '" << std::string(args[0]) << "'" << endl;
+                    return {};
+                }
+
+                std::size_t channel_count = std::min<std::size_t>(source_buffer.frame_count(), 512);
+
+                // Samples of the first channel are interleaved with the others
+                if(source_buffer.channel_count() == 1) {
+                    DmxConvert::fromFloats(&source_buffer.lookup(0, 0), this->_dmx_universe, channel_count);
+                } else {
+                    float samples[512];
+
+                    for(std::size_t i = 0; i < channel_count; i++) {
+                        samples[i] = source_buffer.lookup(i, 0);
+                    }
+
+                    DmxConvert::fromFloats(samples, this->_dmx_universe, channel_count);
+                }
+
+                this->_universeChanged((int)channel_count);
                 return {};
             }
         };
@@ -671,7 +1157,7 @@ class dmxusbpro : public object<dmxusbpro>
                     cwarn << "extra argument for message 'getparams'" << endl;
                 }
 
-                if(!Connector::get().isConnected(this->_getOpenDeviceName())) {
+                if(!this->_is_connected) {
                     if(verbose) {
                         cerr << "Can't get DMX parameters, not connected." << endl;
                     }
@@ -679,7 +1165,7 @@ class dmxusbpro : public object<dmxusbpro>
                     return {};
                 }
 
-                this->_messages_to_device_queue.push(std::vector<unsigned char> {
+                this->_enqueMsgToDevice({
                 MSG_START_CONDITION,
                 MSG_LABEL_GET_WIDGET_PARAMETRES,
                 0x00, 0x00,
@@ -697,7 +1183,7 @@ class dmxusbpro : public object<dmxusbpro>
                     cwarn << "extra argument for message 'getserial'" << endl;
                 }
 
-                if(!Connector::get().isConnected(this->_getOpenDeviceName())) {
+                if(!this->_is_connected) {
                     if(verbose) {
                         cerr << "Can't get serial number, not connected." << endl;
                     }
@@ -705,7 +1191,7 @@ class dmxusbpro : public object<dmxusbpro>
                     return {};
                 }
 
-                this->_messages_to_device_queue.push(std::vector<unsigned char> {
+                this->_enqueMsgToDevice({
                 MSG_START_CONDITION,
                 MSG_LABEL_GET_WIDGET_SERIAL_NUMBER,
                 0x00, 0x00,
@@ -714,6 +1200,30 @@ class dmxusbpro : public object<dmxusbpro>
             }
         };
 
+        message<threadsafe::no> stats {
+            this, "stats", "Send statistics of the DMX pipeline out the dumpout outlet: frames sent (total, per second since the last 'stats'), bytes written, write errors, writes the driver didn't take at once, enqueue to write latency and write() duration (count, mean, median, 99th percentile, maximum in microseconds), send queue depth (current, maximum), dropped frames (replaced by newer ones, send queue full), received frames (total, per second), received DMX dropped, events to Max dropped and parser resyncs, timeouts and skipped bytes.",
+            MIN_FUNCTION {
+                double sent_per_second;
+                double received_per_second;
+
+                this->_stats.rates(sent_per_second, received_per_second);
+
+                output_dumpout.send("framessent", (long)this->_stats.frames_sent.load(), sent_per_second);
+                output_dumpout.send("byteswritten", (long)this->_stats.bytes_written.load());
+                output_dumpout.send("writeerrors", (long)this->_stats.write_errors.load());
+                output_dumpout.send("writestalls", (long)this->_stats.write_stalls.load());
+                this->_sendHistogram("latency", this->_stats.enqueue_to_write.summary());
+                this->_sendHistogram("writetime", this->_stats.write_duration.summary());
+                output_dumpout.send("queuedepth", (long)this->_messages_to_device_queue.size(), (long)this->_stats.send_queue_depth_max.load());
+                output_dumpout.send("framesdropped", (long)this->_stats.frames_replaced.load(), (long)this->_stats.frames_overflowed.load());
+                output_dumpout.send("framesreceived", (long)this->_stats.frames_received.load(), received_per_second);
+                output_dumpout.send("inputdropped", (long)this->_dmx_input_queue.overflowCount());
+                output_dumpout.send("eventsdropped", (long)this->_max_events.overflowCount());
+                output_dumpout.send("parser", (long)this->_device_parser.resyncCount(), (long)this->_device_parser.timeoutCount(), (long)this->_device_parser.skippedBytes());
+                return {};
+            }
+        };
+
         message<threadsafe::yes> close {
             this, "close", "Close the device connection. If <i>keepsending</i> is 0: Stop sending DMX data.",
             MIN_FUNCTION {
@@ -730,7 +1240,7 @@ class dmxusbpro : public object<dmxusbpro>
         message<threadsafe::yes> blackout {
             this, "blackout", "Set all DMX channels temporarily to 0.",
             MIN_FUNCTION {
-                if(!Connector::get().isConnected(this->_getOpenDeviceName())) {
+                if(!this->_is_connected) {
                     if(verbose) {
                         cerr << "Cannot set blackout, not connected" << endl;
                     }
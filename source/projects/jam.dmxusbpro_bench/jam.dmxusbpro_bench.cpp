@@ -0,0 +1,490 @@
+/// @file
+///	@ingroup    jam
+///	@copyright	Copyright 2018 The Min-DevKit Authors. All rights reserved.
+///	@license	Use of this source code is governed by the MIT License found in the License.md file.
+
+// Benchmarks of the hot paths of jam.dmxusbpro and jam.dmxusbpro~, run on the components the objects
+// are built from, so neither Max nor a DMX interface is needed:
+//  - frame encoding as done by _enqueMsgSendDmxPpacket in 'latest' and 'queue' mode
+//  - the 'list' message: clamping channel / value pairs into the universe and storing the frame
+//  - receive parsing and the 'delta' output diff
+//  - the DSP perform routine per multichannel channel count, for every 'reduce' mode
+//  - end-to-end latency from storing a frame to its last byte arriving on a pseudo-terminal
+// Before measuring, the vectorised float conversion is checked against the scalar rules for values
+// out of range, infinities and NaN; a mismatch is reported and makes the run fail.
+// Results are written as JSON to the file given as first argument, or to stdout.
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <poll.h>
+#include <string>
+#include <termios.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "../jam.device_manager/jam.dmxusbpro.device_writer.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.dmx_convert.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.dmx_diff.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.dmx_frame.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.frame_ring.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.frame_slot.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.io_reactor.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.message_parser.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.pipeline_stats.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.signal_reduce.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.universe_update.hpp"
+
+#define BENCH_MIN_DURATION                   200 // ms each measurement runs at least
+#define BENCH_RUNS                           5   // the fastest run is reported
+#define BENCH_PTY_FRAMES                     2000
+#define BENCH_SIGNAL_VECTOR_SIZE             64
+#define BENCH_RECEIVED_MESSAGES              8   // DMX messages in the stream the receive benchmarks parse
+
+namespace s_chrono = std::chrono;
+typedef s_chrono::steady_clock bench_clock_t;
+
+
+// Keeps the optimiser from dropping benchmarked work
+static std::atomic<std::uint64_t> bench_sink { 0 };
+
+
+class BenchReport {
+
+    public:
+
+        // Runs 'operation' in batches until BENCH_MIN_DURATION has passed and records the fastest of BENCH_RUNS runs.
+        // Each call of 'operation' counts as 'op_count' operations.
+        void measure(const std::string &name, const std::function<void()> &operation, std::size_t op_count = 1) {
+            double        best_ns_per_op = 0.;
+            std::uint64_t iterations     = 0;
+
+            for(int run = 0; run < BENCH_RUNS; run++) {
+                std::uint64_t             run_iterations = 0;
+                bench_clock_t::time_point start          = bench_clock_t::now();
+                bench_clock_t::duration   elapsed;
+
+                do {
+                    for(int i = 0; i < 64; i++) {
+                        operation();
+                    }
+
+                    run_iterations += 64 * op_count;
+                    elapsed         = bench_clock_t::now() - start;
+                } while(elapsed < s_chrono::milliseconds(BENCH_MIN_DURATION));
+
+                double ns_per_op = (double)s_chrono::duration_cast<s_chrono::nanoseconds>(elapsed).count() / (double)run_iterations;
+
+                if(run == 0 || ns_per_op < best_ns_per_op) {
+                    best_ns_per_op = ns_per_op;
+                    iterations     = run_iterations;
+                }
+            }
+
+            char entry[256];
+
+            snprintf(entry, sizeof(entry), "{\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.2f, \"ops_per_second\": %.0f}",
+                     name.c_str(), (unsigned long long)iterations, best_ns_per_op, 1e9 / best_ns_per_op);
+            this->_add(entry);
+        }
+
+        void latency(const std::string &name, const LatencyHistogram::summary_t &summary) {
+            char entry[256];
+
+            snprintf(entry, sizeof(entry), "{\"name\": \"%s\", \"count\": %llu, \"mean_us\": %.1f, \"p50_us\": %llu, \"p99_us\": %llu, \"max_us\": %llu}",
+                     name.c_str(), (unsigned long long)summary.count, summary.mean_us,
+                     (unsigned long long)summary.p50_us, (unsigned long long)summary.p99_us, (unsigned long long)summary.max_us);
+            this->_add(entry);
+        }
+
+        void error(const std::string &name, const std::string &message) {
+            this->_add("{\"name\": \"" + name + "\", \"error\": \"" + message + "\"}");
+        }
+
+        bool write(FILE *output) const {
+            fprintf(output, "{\n  \"benchmarks\": [\n");
+
+            for(std::size_t i = 0; i < this->_entries.size(); i++) {
+                fprintf(output, "    %s%s\n", this->_entries[i].c_str(), i + 1 < this->_entries.size() ? "," : "");
+            }
+
+            fprintf(output, "  ]\n}\n");
+            return ferror(output) == 0;
+        }
+
+    private:
+
+        std::vector<std::string> _entries;
+
+        void _add(const std::string &entry) {
+            this->_entries.push_back(entry);
+            fprintf(stderr, "%s\n", entry.c_str());
+        }
+};
+
+
+// DmxConvert::fromFloats on blocks of 8, as the vectorised loop takes them, against the expected values
+static bool checkFloatConversion(BenchReport &report) {
+    const float   nan          = std::numeric_limits<float>::quiet_NaN();
+    const float   infinity     = std::numeric_limits<float>::infinity();
+    float         values[16]   = { 0.f, 0.5f, 1.f, 1.5f, 1000.f, 1e10f, nan, infinity,
+                                   -0.5f, -1e10f, -infinity, -nan, 0.2f, 0.999f, 1.002f, 254.6f / 255.f };
+    unsigned char expected[16] = { 0, 128, 255, 255, 255, 255, 0, 255,
+                                   0, 0, 0, 0, 51, 255, 255, 255 };
+    unsigned char converted[16];
+
+    DmxConvert::fromFloats(values, converted, 16, 255.f);
+
+    for(std::size_t i = 0; i < 16; i++) {
+        if(converted[i] != expected[i]) {
+            report.error("convert_floats", "value " + std::to_string(i) + " converted to " + std::to_string(converted[i]) + " instead of " + std::to_string(expected[i]));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+static void benchFrameEncoding(BenchReport &report) {
+    static LatestFrameSlot<dmx_frame_t> latest_dmx_frame;
+    static device_message_queue_t       messages_to_device_queue;
+    static unsigned char                universe[512];
+    static unsigned char                frame_bytes[dmx_frame_t::max_frame_size];
+
+    for(int i = 0; i < 512; i++) {
+        universe[i] = (unsigned char)i;
+    }
+
+    for(std::size_t channel_count : { (std::size_t)24, (std::size_t)512 }) {
+        std::string channels = std::to_string(channel_count);
+
+        report.measure("frame_encode_" + channels, [channel_count]() {
+            bench_sink += dmx_frame_t::encode(frame_bytes, universe, channel_count);
+        });
+
+        // 'latest' mode: the send thread takes at most every other frame
+        report.measure("frame_store_latest_" + channels, [channel_count, count = 0u]() mutable {
+            latest_dmx_frame.store(universe, channel_count, bench_clock_t::now());
+
+            if((++count & 1) == 0) {
+                bench_sink += latest_dmx_frame.take()->size();
+            }
+        });
+
+        report.measure("frame_push_queue_" + channels, [channel_count]() {
+            messages_to_device_queue.tryPush([channel_count](device_message_t &message) {
+                message.enqueued_at = bench_clock_t::now();
+                message.length      = (std::uint16_t)dmx_frame_t::encode(message.bytes, universe, channel_count);
+            });
+
+            bench_sink += messages_to_device_queue.front()->length;
+            messages_to_device_queue.pop();
+        });
+    }
+}
+
+
+// The 'list' message of jam.dmxusbpro with 'pair_count' channel / value pairs
+static void benchListMessage(BenchReport &report) {
+    static LatestFrameSlot<dmx_frame_t> latest_dmx_frame;
+    static unsigned char                universe[512];
+
+    for(std::size_t pair_count : { (std::size_t)1, (std::size_t)16, (std::size_t)512 }) {
+        std::vector<int> pairs;
+
+        for(std::size_t i = 0; i < pair_count; i++) {
+            pairs.push_back((int)(i * 7 % 512) + 1);
+            pairs.push_back((int)(i * 13 % 300));
+        }
+
+        report.measure("list_" + std::to_string(pair_count) + "_pairs", [pairs]() {
+            int highest_channel = UniverseUpdate::setPairs(universe, pairs, pairs.size());
+
+            latest_dmx_frame.store(universe, (std::size_t)highest_channel, bench_clock_t::now());
+            bench_sink += latest_dmx_frame.take()->size();
+        });
+    }
+}
+
+
+// Received DMX (label 5) fed to the parser in whole messages and in chunks as small reads deliver them
+static void benchReceiveParsing(BenchReport &report) {
+    static EnttecMessageParser parser;
+    static std::vector<unsigned char> stream;
+    static unsigned char previous[DMX_SLOTS];
+    static unsigned char current[DMX_SLOTS];
+
+    for(int message = 0; message < BENCH_RECEIVED_MESSAGES; message++) {
+        std::size_t data_length = 2 + 512;
+
+        stream.insert(stream.end(), { MSG_START_CONDITION, MSG_LABEL_RECEIVED_DMX_PACKET, (unsigned char)(data_length & 0xFF), (unsigned char)(data_length >> 8), 0x00, 0x00 });
+
+        for(int i = 0; i < 512; i++) {
+            stream.push_back((unsigned char)(i + message));
+        }
+
+        stream.push_back(MSG_END_CONDITION);
+    }
+
+    // Every call parses the whole stream in reads of 'chunk_size' bytes, reported per received DMX message
+    for(std::size_t chunk_size : { stream.size(), (std::size_t)64 }) {
+        std::string name = chunk_size == stream.size() ? "receive_parse_whole" : "receive_parse_chunks_" + std::to_string(chunk_size);
+
+        report.measure(name, [chunk_size]() {
+            for(std::size_t position = 0; position < stream.size(); position += chunk_size) {
+                parser.parse(stream.data() + position, std::min(chunk_size, stream.size() - position), [](const unsigned char *, std::size_t message_length) {
+                    bench_sink += message_length;
+                });
+            }
+        }, BENCH_RECEIVED_MESSAGES);
+    }
+
+    report.measure("receive_delta_diff_4_changes", [count = 0u]() mutable {
+        for(int i = 0; i < 4; i++) {
+            current[(count * 37 + (unsigned int)i * 101) % DMX_SLOTS]++;
+        }
+
+        count++;
+        bench_sink += DmxDiff::apply(current, previous, DMX_SLOTS, [](std::size_t, unsigned char value) {
+            bench_sink += value;
+        });
+    });
+}
+
+
+// One signal vector of jam.dmxusbpro~ with 'channel_count' multichannel inlet channels, then with as many
+// argument inlets: every channel is accumulated, then the reduced values are converted into the universe
+// as at the end of a push interval.
+static void benchDspPerform(BenchReport &report) {
+    const char *mode_names[] = { "first", "last", "mean", "peak", "rms" };
+    ReduceMode  modes[]      = { ReduceMode::FIRST, ReduceMode::LAST, ReduceMode::MEAN, ReduceMode::PEAK, ReduceMode::RMS };
+
+    for(std::size_t channel_count : { (std::size_t)1, (std::size_t)16, (std::size_t)128, (std::size_t)512 }) {
+        auto samples  = std::make_shared<std::vector<double> >(channel_count * BENCH_SIGNAL_VECTOR_SIZE);
+        auto reducers = std::make_shared<std::vector<SignalReducer> >(channel_count);
+
+        for(std::size_t i = 0; i < samples->size(); i++) {
+            (*samples)[i] = (double)(i % 97) / 97.;
+        }
+
+        for(std::size_t m = 0; m < 5; m++) {
+            ReduceMode mode = modes[m];
+
+            report.measure("dsp_vector_" + std::to_string(channel_count) + "_channels_" + mode_names[m], [samples, reducers, channel_count, mode]() {
+                static unsigned char universe[512];
+
+                for(std::size_t c = 0; c < channel_count; c++) {
+                    (*reducers)[c].accumulate(samples->data() + c * BENCH_SIGNAL_VECTOR_SIZE, BENCH_SIGNAL_VECTOR_SIZE, mode);
+                }
+
+                bench_sink += UniverseUpdate::fromReducers(reducers->data(), channel_count, mode, 255.f, universe);
+
+                for(SignalReducer &reducer : *reducers) {
+                    reducer.reset();
+                }
+
+                bench_sink += universe[channel_count - 1];
+            });
+
+            // The same count of argument inlets, one DMX channel each
+            auto dmx_channels  = std::make_shared<std::vector<int> >(channel_count);
+            auto pushed_values = std::make_shared<std::vector<int> >(channel_count, -1);
+
+            for(std::size_t i = 0; i < channel_count; i++) {
+                (*dmx_channels)[i] = (int)i + 1;
+            }
+
+            report.measure("dsp_vector_" + std::to_string(channel_count) + "_inlets_" + mode_names[m], [samples, reducers, dmx_channels, pushed_values, channel_count, mode]() {
+                static unsigned char universe[512];
+
+                for(std::size_t c = 0; c < channel_count; c++) {
+                    (*reducers)[c].accumulate(samples->data() + c * BENCH_SIGNAL_VECTOR_SIZE, BENCH_SIGNAL_VECTOR_SIZE, mode);
+                }
+
+                bench_sink += UniverseUpdate::fromInletReducers(reducers->data(), channel_count, mode, 1., dmx_channels->data(), pushed_values->data(), universe);
+
+                for(SignalReducer &reducer : *reducers) {
+                    reducer.reset();
+                }
+
+                bench_sink += universe[channel_count - 1];
+            });
+        }
+    }
+}
+
+
+// Writes frames to the non-blocking slave side of a pseudo-terminal from an IoReactor client, paced by
+// the transmit queue as the objects do with the device, and reads them back on the master side.
+class PtySender : public IoClient {
+
+    public:
+
+        LatestFrameSlot<dmx_frame_t> latest_dmx_frame;
+
+    protected:
+
+        void onIoSend(int fd) override {
+            const dmx_frame_t *dmx_frame;
+            std::size_t        byte_count;
+
+            if(this->_device_writer.resume(fd, byte_count) == DeviceWriter::Result::BLOCKED) {
+                this->_retry();
+                return;
+            }
+
+            if(!this->latest_dmx_frame.pending()) {
+                return;
+            }
+
+            if(DeviceWriter::transmitQueued(fd) > 0) {
+                this->_retry();
+                return;
+            }
+
+            if((dmx_frame = this->latest_dmx_frame.take()) != nullptr
+               && this->_device_writer.write(fd, dmx_frame->data(), dmx_frame->size(), byte_count) == DeviceWriter::Result::BLOCKED) {
+                this->_retry();
+            }
+        }
+
+        void onIoReceive(int) override {}
+
+        void onIoError(int, short) override {}
+
+        void onIoTick(int, bench_clock_t::time_point) override {}
+
+    private:
+
+        DeviceWriter _device_writer;
+
+        void _retry() {
+            this->requestIoSendAt(bench_clock_t::now() + s_chrono::milliseconds(TX_DRAIN_POLL_INTERVAL));
+        }
+};
+
+
+static bool openPty(int &master_fd, int &slave_fd) {
+    struct termios options;
+
+    master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+    if(master_fd < 0 || grantpt(master_fd) != 0 || unlockpt(master_fd) != 0) {
+        return false;
+    }
+
+    slave_fd = open(ptsname(master_fd), O_RDWR | O_NOCTTY);
+
+    if(slave_fd < 0) {
+        return false;
+    }
+
+    // Raw bytes in both directions
+    for(int fd : { master_fd, slave_fd }) {
+        tcgetattr(fd, &options);
+        cfmakeraw(&options);
+        tcsetattr(fd, TCSANOW, &options);
+    }
+
+    // Opened like the device by the Connector
+    fcntl(slave_fd, F_SETFL, fcntl(slave_fd, F_GETFL) | O_NONBLOCK);
+
+    return true;
+}
+
+
+static void benchPtyEndToEnd(BenchReport &report) {
+    for(std::size_t channel_count : { (std::size_t)24, (std::size_t)512 }) {
+        std::string         name = "pty_end_to_end_" + std::to_string(channel_count);
+        int                 master_fd;
+        int                 slave_fd;
+        IoReactor           reactor(1);
+        PtySender           sender;
+        EnttecMessageParser parser;
+        LatencyHistogram    latency;
+        unsigned char       universe[512];
+        unsigned char       read_buffer[SERIAL_IN_BUFF_SIZE];
+
+        if(!openPty(master_fd, slave_fd)) {
+            report.error(name, "can't open a pseudo-terminal");
+            return;
+        }
+
+        reactor.add(&sender, slave_fd);
+
+        for(int frame = 0; frame < BENCH_PTY_FRAMES; frame++) {
+            bool                      received = false;
+            bench_clock_t::time_point start    = bench_clock_t::now();
+
+            memset(universe, frame & 0xFF, sizeof(universe));
+            sender.latest_dmx_frame.store(universe, channel_count, start);
+            sender.requestIoSend();
+
+            while(!received) {
+                struct pollfd poll_fd = { master_fd, POLLIN, 0 };
+
+                if(poll(&poll_fd, 1, 1000) <= 0) {
+                    break;
+                }
+
+                ssize_t byte_count = read(master_fd, read_buffer, sizeof(read_buffer));
+
+                if(byte_count <= 0) {
+                    break;
+                }
+
+                parser.parse(read_buffer, (std::size_t)byte_count, [&received](const unsigned char *message, std::size_t) {
+                    received = message[1] == MSG_LABEL_SEND_DMX_PACKET;
+                });
+            }
+
+            if(!received) {
+                report.error(name, "frame not received");
+                break;
+            }
+
+            latency.record(bench_clock_t::now() - start);
+        }
+
+        reactor.remove(&sender);
+        close(slave_fd);
+        close(master_fd);
+        report.latency(name, latency.summary());
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    BenchReport report;
+    FILE        *output     = stdout;
+    bool        is_correct = checkFloatConversion(report);
+
+    benchFrameEncoding(report);
+    benchListMessage(report);
+    benchReceiveParsing(report);
+    benchDspPerform(report);
+    benchPtyEndToEnd(report);
+
+    if(argc > 1 && (output = fopen(argv[1], "w")) == nullptr) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    bool written = report.write(output);
+
+    if(output != stdout) {
+        fclose(output);
+    }
+
+    return written && is_correct ? 0 : 1;
+}
@@ -0,0 +1,636 @@
+/// @file
+///	@ingroup    jam
+///	@copyright	Copyright 2018 The Min-DevKit Authors. All rights reserved.
+///	@license	Use of this source code is governed by the MIT License found in the License.md file.
+
+// Emulates an ENTTEC DMX USB Pro on a pseudo-terminal, so jam.dmxusbpro, jam.dmxusbpro~ and the
+// Connector can be load tested without an interface. Open the printed slave path, or the --link path,
+// by its absolute path: 'open /tmp/dmxusbpro'.
+//  - answers labels 3 (get widget parameters) and 10 (serial number), stores label 4 parameters
+//  - records every received message with a timestamp, label 6 frames included, as JSON lines
+//  - sends input DMX at a configurable rate: label 5 packets, or label 9 change packets after a
+//    label 8 'send on change' request
+//  - injects faults: messages split over several writes, garbage bytes between messages, unplug and replug
+// A summary is printed when the emulator is stopped with ctrl-c.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <poll.h>
+#include <random>
+#include <string>
+#include <termios.h>
+#include <unistd.h>
+#include <vector>
+#include "../jam.device_manager/jam.dmxusbpro.message_parser.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.pipeline_stats.hpp"
+
+#define EMULATOR_FIRMWARE_MSB                1
+#define EMULATOR_FIRMWARE_LSB                44
+#define EMULATOR_SERIAL_NUMBER               0x12345678
+#define EMULATOR_BREAK_TIME                  9   // units of 10.67 us
+#define EMULATOR_MAB_TIME                    1   // units of 10.67 us
+#define EMULATOR_REFRESH_RATE                40  // packets per second
+#define EMULATOR_READ_BUFF_SIZE              4096
+#define EMULATOR_IDLE_TIMEOUT                250 // ms poll() waits without deadlines
+#define EMULATOR_MAX_PENDING_OUTPUT          65536 // input DMX is dropped while the client doesn't read
+#define EMULATOR_SPLIT_DELAY                 1   // ms between the parts of a split message
+#define EMULATOR_MAX_GARBAGE                 16  // most garbage bytes inserted before a message
+
+namespace s_chrono = std::chrono;
+typedef s_chrono::steady_clock emulator_clock_t;
+
+
+typedef struct {
+    std::size_t size;
+    bool        is_split; // more parts of the same message follow
+} output_part_t;
+
+
+typedef struct {
+    std::string   link_path;
+    std::string   record_path;
+    double        input_rate          = 0.;  // input DMX packets per second, 0: no input
+    int           input_changes       = 512; // channels changed per input packet
+    int           split_parts         = 1;   // writes each message is split into, at random positions
+    double        garbage_probability = 0.;  // chance of garbage bytes before a message
+    double        unplug_after        = 0.;  // seconds after plugging, 0: never
+    double        replug_after        = 0.;  // seconds after unplugging, 0: quit instead
+    std::uint32_t serial_number       = EMULATOR_SERIAL_NUMBER;
+    unsigned int  seed                = 1;
+} emulator_options_t;
+
+
+static volatile sig_atomic_t emulator_stop = 0;
+
+static void stopEmulator(int) {
+    emulator_stop = 1;
+}
+
+
+class EnttecEmulator {
+
+    public:
+
+        explicit EnttecEmulator(const emulator_options_t &options) : _options(options), _random(options.seed) {
+            memset(this->_input_universe, 0, DMX_SLOTS);
+            memset(this->_input_sent, 0, DMX_SLOTS);
+        }
+
+        ~EnttecEmulator() {
+            this->_unplug();
+
+            if(this->_record != nullptr) {
+                fclose(this->_record);
+            }
+        }
+
+        bool run() {
+            this->_start_time = emulator_clock_t::now();
+
+            if(!this->_options.record_path.empty() && (this->_record = fopen(this->_options.record_path.c_str(), "w")) == nullptr) {
+                perror(this->_options.record_path.c_str());
+                return false;
+            }
+
+            if(!this->_plug()) {
+                return false;
+            }
+
+            while(!emulator_stop) {
+                emulator_clock_t::time_point now = emulator_clock_t::now();
+
+                if(this->_master_fd < 0) {
+                    if(now < this->_replug_at) {
+                        this->_sleepUntil(this->_replug_at);
+                    } else if(!this->_plug()) {
+                        return false;
+                    }
+
+                    continue;
+                }
+
+                if(this->_options.unplug_after > 0. && now >= this->_unplug_at) {
+                    this->_unplug();
+
+                    if(this->_options.replug_after <= 0.) {
+                        break;
+                    }
+
+                    this->_replug_at = now + this->_seconds(this->_options.replug_after);
+                    continue;
+                }
+
+                if(this->_options.input_rate > 0. && now >= this->_next_input) {
+                    this->_sendInput();
+                    this->_next_input += this->_seconds(1. / this->_options.input_rate);
+
+                    // Too far behind: skip the missed packets instead of sending them in a burst
+                    if(this->_next_input < now) {
+                        this->_next_input = now + this->_seconds(1. / this->_options.input_rate);
+                    }
+                }
+
+                this->_flush(now);
+                this->_poll(now);
+            }
+
+            return true;
+        }
+
+        void printSummary(FILE *output) {
+            LatencyHistogram::summary_t intervals = this->_frame_intervals.summary();
+            double                      elapsed   = s_chrono::duration<double>(emulator_clock_t::now() - this->_start_time).count();
+
+            fprintf(output, "messages received:   %llu (labels 3: %llu, 4: %llu, 6: %llu, 8: %llu, 10: %llu, other: %llu)\n",
+                    (unsigned long long)this->_messages_received,
+                    (unsigned long long)this->_label_counts[MSG_LABEL_GET_WIDGET_PARAMETRES],
+                    (unsigned long long)this->_label_counts[MSG_LABEL_SET_WIDGET_PARAMETRES],
+                    (unsigned long long)this->_label_counts[MSG_LABEL_SEND_DMX_PACKET],
+                    (unsigned long long)this->_label_counts[MSG_LABEL_RECEIVE_DMX],
+                    (unsigned long long)this->_label_counts[MSG_LABEL_GET_WIDGET_SERIAL_NUMBER],
+                    (unsigned long long)this->_unknown_messages);
+            fprintf(output, "frames received:     %llu (%.1f per second)\n",
+                    (unsigned long long)this->_label_counts[MSG_LABEL_SEND_DMX_PACKET],
+                    elapsed > 0. ? (double)this->_label_counts[MSG_LABEL_SEND_DMX_PACKET] / elapsed : 0.);
+            fprintf(output, "frame interval us:   mean %.1f, p50 %llu, p99 %llu, max %llu\n",
+                    intervals.mean_us, (unsigned long long)intervals.p50_us, (unsigned long long)intervals.p99_us, (unsigned long long)intervals.max_us);
+            fprintf(output, "bytes received:      %llu\n", (unsigned long long)this->_bytes_received);
+            fprintf(output, "parser resyncs:      %llu, skipped bytes: %llu\n",
+                    (unsigned long long)this->_parser.resyncCount(), (unsigned long long)this->_parser.skippedBytes());
+            fprintf(output, "input packets sent:  %llu, dropped: %llu\n",
+                    (unsigned long long)this->_input_packets_sent, (unsigned long long)this->_input_packets_dropped);
+            fprintf(output, "bytes sent:          %llu, garbage: %llu\n",
+                    (unsigned long long)this->_bytes_sent, (unsigned long long)this->_garbage_bytes);
+            fprintf(output, "plugged:             %llu times\n", (unsigned long long)this->_plug_count);
+        }
+
+    private:
+
+        emulator_options_t _options;
+        std::mt19937 _random;
+        int _master_fd = -1;
+        int _slave_fd  = -1; // kept open, so the master doesn't hang up while no client has the port open
+        std::string _slave_path;
+        FILE *_record  = nullptr;
+        EnttecMessageParser _parser;
+        std::vector<unsigned char> _output;       // bytes not written yet
+        std::deque<output_part_t> _output_parts;  // writes _output is split into
+        emulator_clock_t::time_point _start_time;
+        emulator_clock_t::time_point _unplug_at;
+        emulator_clock_t::time_point _replug_at;
+        emulator_clock_t::time_point _next_input;
+        emulator_clock_t::time_point _next_write;
+        emulator_clock_t::time_point _last_frame;
+        bool _send_on_change        = false;
+        unsigned char _break_time   = EMULATOR_BREAK_TIME;
+        unsigned char _mab_time     = EMULATOR_MAB_TIME;
+        unsigned char _refresh_rate = EMULATOR_REFRESH_RATE;
+        unsigned char _input_universe[DMX_SLOTS]; // start code and channels of the emulated DMX input
+        unsigned char _input_sent[DMX_SLOTS];     // as last sent in change packets
+        LatencyHistogram _frame_intervals;
+        std::uint64_t _label_counts[256] {};
+        std::uint64_t _messages_received     = 0;
+        std::uint64_t _unknown_messages      = 0;
+        std::uint64_t _bytes_received        = 0;
+        std::uint64_t _bytes_sent            = 0;
+        std::uint64_t _garbage_bytes         = 0;
+        std::uint64_t _input_packets_sent    = 0;
+        std::uint64_t _input_packets_dropped = 0;
+        std::uint64_t _plug_count            = 0;
+
+        static emulator_clock_t::duration _seconds(double seconds) {
+            return s_chrono::duration_cast<emulator_clock_t::duration>(s_chrono::duration<double>(seconds));
+        }
+
+        std::uint64_t _elapsedMicroseconds() const {
+            return (std::uint64_t)s_chrono::duration_cast<s_chrono::microseconds>(emulator_clock_t::now() - this->_start_time).count();
+        }
+
+        void _sleepUntil(emulator_clock_t::time_point time) {
+            s_chrono::milliseconds timeout = s_chrono::duration_cast<s_chrono::milliseconds>(time - emulator_clock_t::now());
+
+            poll(nullptr, 0, (int)std::max<s_chrono::milliseconds::rep>(timeout.count() + 1, 0));
+        }
+
+        // A new pseudo-terminal, as if the interface had been plugged in
+        bool _plug() {
+            struct termios options;
+
+            this->_master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+            if(this->_master_fd < 0 || grantpt(this->_master_fd) != 0 || unlockpt(this->_master_fd) != 0) {
+                perror("posix_openpt");
+                this->_unplug();
+                return false;
+            }
+
+            const char *slave_path = ptsname(this->_master_fd);
+
+            if(slave_path == nullptr || (this->_slave_fd = open(slave_path, O_RDWR | O_NOCTTY)) < 0) {
+                perror("ptsname");
+                this->_unplug();
+                return false;
+            }
+
+            this->_slave_path = slave_path;
+
+            // Raw bytes. The termios options are shared with the client, which sets its own on opening
+            // and then checks them: they aren't touched again.
+            tcgetattr(this->_slave_fd, &options);
+            cfmakeraw(&options);
+            tcsetattr(this->_slave_fd, TCSANOW, &options);
+            fcntl(this->_master_fd, F_SETFL, fcntl(this->_master_fd, F_GETFL) | O_NONBLOCK);
+
+            if(!this->_options.link_path.empty()) {
+                unlink(this->_options.link_path.c_str());
+
+                if(symlink(slave_path, this->_options.link_path.c_str()) != 0) {
+                    perror(this->_options.link_path.c_str());
+                }
+            }
+
+            emulator_clock_t::time_point now = emulator_clock_t::now();
+
+            this->_unplug_at  = now + this->_seconds(this->_options.unplug_after);
+            this->_next_input = now;
+            this->_next_write = now;
+            this->_last_frame = emulator_clock_t::time_point();
+            this->_send_on_change = false;
+            this->_output.clear();
+            this->_output_parts.clear();
+            this->_parser.reset();
+            memset(this->_input_sent, 0, DMX_SLOTS);
+            this->_plug_count++;
+
+            printf("%s\n", this->_options.link_path.empty() ? slave_path : this->_options.link_path.c_str());
+            fflush(stdout);
+            this->_recordEvent("plug", slave_path);
+            return true;
+        }
+
+        // The client's reads and writes fail with EIO from now on, as with an unplugged interface
+        void _unplug() {
+            if(this->_master_fd < 0 && this->_slave_fd < 0) {
+                return;
+            }
+
+            if(this->_slave_fd >= 0) {
+                close(this->_slave_fd);
+                this->_slave_fd = -1;
+            }
+
+            if(this->_master_fd >= 0) {
+                close(this->_master_fd);
+                this->_master_fd = -1;
+            }
+
+            if(!this->_options.link_path.empty()) {
+                unlink(this->_options.link_path.c_str());
+            }
+
+            this->_recordEvent("unplug", this->_slave_path.c_str());
+        }
+
+        void _poll(emulator_clock_t::time_point now) {
+            emulator_clock_t::time_point wake_at  = now + s_chrono::milliseconds(EMULATOR_IDLE_TIMEOUT);
+            struct pollfd                poll_fd = { this->_master_fd, POLLIN, 0 };
+            unsigned char                buffer[EMULATOR_READ_BUFF_SIZE];
+
+            if(!this->_output.empty()) {
+                if(now >= this->_next_write) {
+                    poll_fd.events |= POLLOUT;
+                } else {
+                    wake_at = std::min(wake_at, this->_next_write);
+                }
+            }
+
+            if(this->_options.input_rate > 0.) {
+                wake_at = std::min(wake_at, this->_next_input);
+            }
+
+            if(this->_options.unplug_after > 0.) {
+                wake_at = std::min(wake_at, this->_unplug_at);
+            }
+
+            // Rounded up: waking a little late is better than spinning until the deadline
+            s_chrono::microseconds timeout = s_chrono::duration_cast<s_chrono::microseconds>(wake_at - now);
+            int                    timeout_ms = (int)std::max<s_chrono::microseconds::rep>((timeout.count() + 999) / 1000, 0);
+
+            if(poll(&poll_fd, 1, timeout_ms) <= 0 || (poll_fd.revents & POLLIN) == 0) {
+                return;
+            }
+
+            ssize_t byte_count = read(this->_master_fd, buffer, sizeof(buffer));
+
+            if(byte_count <= 0) {
+                return;
+            }
+
+            this->_bytes_received += (std::uint64_t)byte_count;
+            this->_parser.parse(buffer, (std::size_t)byte_count, [this](const unsigned char *message, std::size_t length) {
+                this->_processMessage(message, length);
+            });
+        }
+
+        // 'message' is [start, label, length lsb, length msb, data..., end]
+        void _processMessage(const unsigned char *message, std::size_t length) {
+            const unsigned char *data        = message + 4;
+            std::size_t          data_length = length - EnttecMessageParser::overhead_size;
+            unsigned char        label       = message[1];
+
+            this->_messages_received++;
+            this->_label_counts[label]++;
+            this->_recordMessage(label, data, data_length);
+
+            switch (label) {
+                case MSG_LABEL_GET_WIDGET_PARAMETRES: {
+                    unsigned char parameters[] = { EMULATOR_FIRMWARE_LSB, EMULATOR_FIRMWARE_MSB, this->_break_time, this->_mab_time, this->_refresh_rate };
+
+                    this->_sendMessage(MSG_LABEL_GET_WIDGET_PARAMETRES, parameters, sizeof(parameters));
+                    return;
+                }
+
+                case MSG_LABEL_SET_WIDGET_PARAMETRES:
+                    // user configuration size lsb, msb, break time, MAB time, refresh rate
+                    if(data_length >= 5) {
+                        this->_break_time   = data[2];
+                        this->_mab_time     = data[3];
+                        this->_refresh_rate = data[4];
+                    }
+
+                    return;
+
+                case MSG_LABEL_SEND_DMX_PACKET: {
+                    emulator_clock_t::time_point now = emulator_clock_t::now();
+
+                    if(this->_last_frame != emulator_clock_t::time_point()) {
+                        this->_frame_intervals.record(now - this->_last_frame);
+                    }
+
+                    this->_last_frame = now;
+                    return;
+                }
+
+                case MSG_LABEL_RECEIVE_DMX:
+                    // 0: send every packet with label 5, 1: send changes only with label 9
+                    if(data_length >= 1) {
+                        this->_send_on_change = data[0] == 0x01;
+                        memset(this->_input_sent, 0, DMX_SLOTS);
+                    }
+
+                    return;
+
+                case MSG_LABEL_GET_WIDGET_SERIAL_NUMBER: {
+                    std::uint32_t serial_number   = this->_options.serial_number;
+                    unsigned char serial_bytes[4] = {
+                        (unsigned char)(serial_number & 0xFF),
+                        (unsigned char)((serial_number >> 8) & 0xFF),
+                        (unsigned char)((serial_number >> 16) & 0xFF),
+                        (unsigned char)((serial_number >> 24) & 0xFF)
+                    };
+
+                    this->_sendMessage(MSG_LABEL_GET_WIDGET_SERIAL_NUMBER, serial_bytes, sizeof(serial_bytes));
+                    return;
+                }
+
+                default:
+                    // The interface ignores labels it doesn't know
+                    this->_unknown_messages++;
+                    return;
+            }
+        }
+
+        // One packet of the emulated DMX input with 'input_changes' channels set to new values
+        void _sendInput() {
+            std::uniform_int_distribution<int> channel_distribution(1, 512);
+            std::uniform_int_distribution<int> step_distribution(1, 255);
+
+            if(this->_output.size() > EMULATOR_MAX_PENDING_OUTPUT) {
+                this->_input_packets_dropped++;
+                return;
+            }
+
+            for(int i = 0; i < this->_options.input_changes; i++) {
+                int channel = this->_options.input_changes >= 512 ? i % 512 + 1 : channel_distribution(this->_random);
+
+                this->_input_universe[channel] = (unsigned char)(this->_input_universe[channel] + step_distribution(this->_random));
+            }
+
+            this->_input_packets_sent++;
+
+            if(!this->_send_on_change) {
+                // status, start code and channels
+                unsigned char packet[1 + DMX_SLOTS];
+
+                packet[0] = 0x00;
+                memcpy(packet + 1, this->_input_universe, DMX_SLOTS);
+                this->_sendMessage(MSG_LABEL_RECEIVED_DMX_PACKET, packet, sizeof(packet));
+                return;
+            }
+
+            // Change packets cover DMX_CHANGE_MASK_BYTES * 8 slots from a start block: [block, mask..., values...]
+            const std::size_t block_slots = DMX_CHANGE_MASK_BYTES * 8;
+
+            for(std::size_t first_slot = 0; first_slot < DMX_SLOTS; first_slot += block_slots) {
+                unsigned char packet[1 + DMX_CHANGE_MASK_BYTES + block_slots] = {};
+                std::size_t   packet_length = 1 + DMX_CHANGE_MASK_BYTES;
+
+                packet[0] = (unsigned char)(first_slot / DMX_CHANGE_BLOCK_SIZE);
+
+                for(std::size_t bit = 0; bit < block_slots && first_slot + bit < DMX_SLOTS; bit++) {
+                    std::size_t slot = first_slot + bit;
+
+                    if(this->_input_universe[slot] == this->_input_sent[slot]) {
+                        continue;
+                    }
+
+                    packet[1 + bit / 8]      |= (unsigned char)(1 << (bit % 8));
+                    packet[packet_length++]   = this->_input_universe[slot];
+                    this->_input_sent[slot]   = this->_input_universe[slot];
+                }
+
+                if(packet_length > 1 + DMX_CHANGE_MASK_BYTES) {
+                    this->_sendMessage(MSG_LABEL_RECEIVED_DMX_PACKET_CHANGE, packet, packet_length);
+                }
+            }
+        }
+
+        void _sendMessage(unsigned char label, const unsigned char *data, std::size_t data_length) {
+            std::uniform_real_distribution<double> chance(0., 1.);
+            std::size_t                            message_start = this->_output.size();
+
+            if(this->_options.garbage_probability > 0. && chance(this->_random) < this->_options.garbage_probability) {
+                std::uniform_int_distribution<int> count_distribution(1, EMULATOR_MAX_GARBAGE);
+                std::uniform_int_distribution<int> byte_distribution(0, 255);
+                int                                count = count_distribution(this->_random);
+
+                // Without start bytes, so the garbage doesn't swallow the message that follows
+                for(int i = 0; i < count; i++) {
+                    unsigned char byte = (unsigned char)byte_distribution(this->_random);
+
+                    this->_output.push_back(byte == MSG_START_CONDITION ? 0x00 : byte);
+                }
+
+                this->_garbage_bytes += (std::uint64_t)count;
+            }
+
+            this->_output.insert(this->_output.end(), { MSG_START_CONDITION, label, (unsigned char)(data_length & 0xFF), (unsigned char)(data_length >> 8) });
+            this->_output.insert(this->_output.end(), data, data + data_length);
+            this->_output.push_back(MSG_END_CONDITION);
+
+            // Cut the message at 'split_parts' - 1 random positions
+            std::size_t              message_length = this->_output.size() - message_start;
+            std::vector<std::size_t> cuts;
+            std::uniform_int_distribution<std::size_t> cut_distribution(1, message_length - 1);
+
+            for(int i = 1; i < this->_options.split_parts; i++) {
+                cuts.push_back(cut_distribution(this->_random));
+            }
+
+            std::sort(cuts.begin(), cuts.end());
+            cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+            cuts.push_back(message_length);
+
+            for(std::size_t i = 0, previous_cut = 0; i < cuts.size(); previous_cut = cuts[i], i++) {
+                this->_output_parts.push_back({ cuts[i] - previous_cut, i + 1 < cuts.size() });
+            }
+        }
+
+        // Writes pending output. The parts of a split message are written EMULATOR_SPLIT_DELAY ms apart.
+        void _flush(emulator_clock_t::time_point now) {
+            while(!this->_output_parts.empty() && now >= this->_next_write) {
+                output_part_t &part    = this->_output_parts.front();
+                ssize_t        written = write(this->_master_fd, this->_output.data(), part.size);
+
+                if(written <= 0) {
+                    // EAGAIN: the client doesn't read, poll() reports when it does again
+                    return;
+                }
+
+                this->_output.erase(this->_output.begin(), this->_output.begin() + written);
+                this->_bytes_sent += (std::uint64_t)written;
+
+                if((std::size_t)written < part.size) {
+                    part.size -= (std::size_t)written;
+                    continue;
+                }
+
+                if(part.is_split) {
+                    this->_next_write = now + s_chrono::milliseconds(EMULATOR_SPLIT_DELAY);
+                }
+
+                this->_output_parts.pop_front();
+            }
+        }
+
+        void _recordMessage(unsigned char label, const unsigned char *data, std::size_t data_length) {
+            static const char hex_digits[] = "0123456789abcdef";
+
+            if(this->_record == nullptr) {
+                return;
+            }
+
+            fprintf(this->_record, "{\"time_us\": %llu, \"label\": %u, \"length\": %zu, \"data\": \"",
+                    (unsigned long long)this->_elapsedMicroseconds(), (unsigned int)label, data_length);
+
+            for(std::size_t i = 0; i < data_length; i++) {
+                fputc(hex_digits[data[i] >> 4], this->_record);
+                fputc(hex_digits[data[i] & 0x0F], this->_record);
+            }
+
+            fputs("\"}\n", this->_record);
+        }
+
+        void _recordEvent(const char *event, const char *path) {
+            if(this->_record == nullptr) {
+                return;
+            }
+
+            fprintf(this->_record, "{\"time_us\": %llu, \"event\": \"%s\", \"path\": \"%s\"}\n",
+                    (unsigned long long)this->_elapsedMicroseconds(), event, path);
+        }
+};
+
+
+static void printUsage(const char *program) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --link PATH         symlink PATH to the pseudo-terminal, also after replugging\n"
+            "  --record FILE       record received messages as JSON lines\n"
+            "  --input-rate HZ     send input DMX packets at HZ\n"
+            "  --input-changes N   channels changed per input packet (default 512)\n"
+            "  --split N           split messages into N writes, %d ms apart\n"
+            "  --garbage P         insert garbage bytes before a message with probability P\n"
+            "  --unplug-after S    unplug S seconds after plugging\n"
+            "  --replug-after S    plug again S seconds after unplugging\n"
+            "  --serial HEX        serial number (default %08X)\n"
+            "  --seed N            seed of the random input and faults\n",
+            program, EMULATOR_SPLIT_DELAY, EMULATOR_SERIAL_NUMBER);
+}
+
+
+int main(int argc, char *argv[]) {
+    emulator_options_t options;
+    struct sigaction   stop_action;
+
+    for(int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+
+        if(option == "--help") {
+            printUsage(argv[0]);
+            return 0;
+        }
+
+        if(i + 1 >= argc) {
+            printUsage(argv[0]);
+            return 1;
+        }
+
+        const char *value = argv[++i];
+
+        if(option == "--link") {
+            options.link_path = value;
+        } else if(option == "--record") {
+            options.record_path = value;
+        } else if(option == "--input-rate") {
+            options.input_rate = atof(value);
+        } else if(option == "--input-changes") {
+            options.input_changes = std::min(512, std::max(0, atoi(value)));
+        } else if(option == "--split") {
+            options.split_parts = std::max(1, atoi(value));
+        } else if(option == "--garbage") {
+            options.garbage_probability = atof(value);
+        } else if(option == "--unplug-after") {
+            options.unplug_after = atof(value);
+        } else if(option == "--replug-after") {
+            options.replug_after = atof(value);
+        } else if(option == "--serial") {
+            options.serial_number = (std::uint32_t)strtoul(value, nullptr, 16);
+        } else if(option == "--seed") {
+            options.seed = (unsigned int)strtoul(value, nullptr, 10);
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    // Without SA_RESTART, so poll() returns when the emulator is stopped
+    memset(&stop_action, 0, sizeof(stop_action));
+    stop_action.sa_handler = stopEmulator;
+    sigaction(SIGINT, &stop_action, nullptr);
+    sigaction(SIGTERM, &stop_action, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    EnttecEmulator emulator(options);
+    bool           success = emulator.run();
+
+    emulator.printSummary(stderr);
+    return success ? 0 : 1;
+}
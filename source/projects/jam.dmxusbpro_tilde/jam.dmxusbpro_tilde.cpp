@@ -4,14 +4,26 @@
 ///	@license	Use of this source code is governed by the MIT License found in the License.md file.
 
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <chrono>
+#include <cmath>
 #include <cstddef>
-#include <map>
 #include <mutex>
-#include <queue>
 #include <thread>
 #include <vector>
+#include "../jam.device_manager/jam.dmxusbpro.device_writer.hpp"
 #include "../jam.device_manager/jam.dmxusbpro.dmx_device.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.dmx_frame.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.frame_ring.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.frame_slot.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.io_reactor.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.max_event.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.message_parser.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.pipeline_stats.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.sample_clock.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.signal_reduce.hpp"
+#include "../jam.device_manager/jam.dmxusbpro.universe_update.hpp"
 #include "c74_min.h"
 
 #define OBJECT_MESSAGE_PREFIX              "jam.dmxusbpro~ • "
@@ -20,40 +32,133 @@
 using namespace c74::min;
 namespace s_chrono = std::chrono;
 
-class dmxusbpro_tilde : public object<dmxusbpro_tilde>, public vector_operator<>
+class dmxusbpro_tilde : public object<dmxusbpro_tilde>, public mc_operator<>, public IoClient
 {
     private:
 
         std::vector< std::unique_ptr<inlet<> > > _inlets;
+        std::unique_ptr<inlet<> > _mc_inlet; // created after the argument inlets, so they keep their positions
+        std::vector<std::atomic<int> > _inlet_channel_counts; // channels per signal inlet reported by 'inputchanged': master, argument inlets, multichannel inlet
+        std::vector<std::size_t> _inlet_first_channels; // where each signal inlet starts in the audio_bundle. Audio thread only.
         std::vector<int> _inlet_dmx_channel;
+        std::vector<int> _inlet_dmx_value; // last value pushed per inlet, -1 before the first push. Audio thread only.
+        std::size_t _samples_until_push = 0; // samples from the start of the next signal vector to the next push
+        bool _is_pushing = false; // the previous signal vector was reduced for a connected device. Audio thread only.
+        SampleClock _sample_clock;
+        std::vector<SignalReducer> _reducers; // master, 512 multichannel channels, argument inlets. Audio thread only.
+        ReduceMode _reduced_mode = ReduceMode::LAST; // mode the reducers accumulate for. Audio thread only.
+        s_chrono::steady_clock::time_point _last_release_at; // release time of the last scheduled frame. Audio thread only.
 
     protected:
 
-        bool _io_threads_continue = false;
-        std::thread _receive_thread;
-        std::thread _send_thread;
+        std::atomic<bool> _device_lost { false };
+        std::atomic<bool> _is_connected { false };
+        Connector::connection_t _connection;
         std::mutex _open_device_lock;
-        std::mutex _enque_msg_lock;
-        std::queue<std::vector<unsigned char> > _messages_to_device_queue;
+        device_message_queue_t _messages_to_device_queue;
+        LatestFrameSlot<dmx_frame_t> _latest_dmx_frame;
+        scheduled_message_queue_t _scheduled_dmx_frames;
+        scheduled_message_t _due_dmx_frame; // send thread only
+        bool _has_due_dmx_frame = false;    // send thread only
         std::string _open_device_name = "";
-        fifo<atoms> _to_max_queue { 1000 };
+        max_event_queue_t _max_events;
+        std::atomic<bool> _delivery_scheduled { false };
+        std::atomic<int> _highest_channel { 0 };
+        std::atomic<bool> _send_latest { true };     // attributes read by the audio thread
+        std::atomic<int> _channel_count_setting { 512 };
+        std::atomic<int> _push_interval { 20 };
+        std::atomic<int> _latency { 0 };
+        std::atomic<int> _mc_address { 0 };
+        std::atomic<ReduceMode> _reduce_mode { ReduceMode::LAST };
         unsigned char _dmx_universe[512];
         unsigned char _serial_in_buffer[SERIAL_IN_BUFF_SIZE];
+        EnttecMessageParser _device_parser;
+        DeviceWriter _device_writer; // send thread only
+        PipelineStats _stats;
         dict _connections { symbol("__jamproconnections__") }; // Workaround until I find a way to make the device manager global
 
-        void _enque_msg_to_max(const atoms &msg_to_max) {
-            _enque_msg_lock.lock();
-            this->_to_max_queue.try_enqueue(msg_to_max);
-            _enque_msg_lock.unlock();
+        void _enqueMaxEvent(std::uint8_t destination, MaxEventType type, std::initializer_list<int> values, const char *text = "") {
+            enqueMaxEvent(this->_max_events, destination, type, values, text);
+            this->_scheduleDelivery();
         }
 
-        bool _dequeue_msg_to_max(atoms &msg_data) {
-            _enque_msg_lock.lock();
+        // Wakes the Max thread once for everything queued until deliverer_to_max runs
+        void _scheduleDelivery() {
+            if(!this->_delivery_scheduled.exchange(true, std::memory_order_acq_rel)) {
+                deliverer_to_max.delay(0);
+            }
+        }
+
+        void _sendToMax(std::uint8_t destination, const atoms &message) {
+            switch (destination) {
+                case TO_OUTLET_1:
+                    output_1.send(message);
+                    break;
+
+                case TO_OUTLET_2:
+                    output_2.send(message);
+                    break;
+
+                case TO_OUTLET_3:
+                    output_3.send(message);
+                    break;
+
+                case TO_OUTLET_DUMPOUT:
+                    output_dumpout.send(message);
+                    break;
+
+                case TO_MAX_CONSOLE:
+
+                    for(std::size_t i = 0; i < message.size(); i++) {
+                        cout << message[i] << endl;
+                    }
+
+                    break;
+
+                case TO_MAX_CONSOLE_WARN:
+
+                    for(std::size_t i = 0; i < message.size(); i++) {
+                        cwarn << message[i] << endl;
+                    }
+
+                    break;
+
+                case TO_MAX_CONSOLE_ERROR:
+
+                    for(std::size_t i = 0; i < message.size(); i++) {
+                        cerr << message[i] << endl;
+                    }
 
-            bool result = this->_to_max_queue.try_dequeue(msg_data);
+                    break;
+            }
+        }
 
-            _enque_msg_lock.unlock();
-            return result;
+        void _sendHistogram(const char *name, const LatencyHistogram::summary_t &summary) {
+            output_dumpout.send(name, (long)summary.count, summary.mean_us, (long)summary.p50_us, (long)summary.p99_us, (long)summary.max_us);
+        }
+
+        // Turns an event into atoms and sends it out. Max thread only.
+        void _deliverMaxEvent(const max_event_t &event) {
+            switch (event.type) {
+                case MaxEventType::CONNECTION_STATE:
+                    this->_sendToMax(event.destination, { event.values[0] });
+                    break;
+
+                case MaxEventType::DEVICE_SETTINGS:
+                    this->_sendToMax(event.destination, { "firmware", symbol(event.text) });
+                    this->_sendToMax(event.destination, { "breaktime", event.values[0] });
+                    this->_sendToMax(event.destination, { "mabtime", event.values[1] });
+                    this->_sendToMax(event.destination, { "refresh", event.values[2] });
+                    break;
+
+                case MaxEventType::SERIAL_NUMBER:
+                    this->_sendToMax(event.destination, { "serialnumber", symbol(event.text) });
+                    break;
+
+                case MaxEventType::TEXT:
+                    this->_sendToMax(event.destination, { symbol(event.text) });
+                    break;
+            }
         }
 
         void _setOpenDeviceName(std::string device_name) {
@@ -67,10 +172,10 @@ class dmxusbpro_tilde : public object<dmxusbpro_tilde>, public vector_operator<>
         }
 
         void _closeDevice() {
-            if(Connector::get().isConnected(this->_getOpenDeviceName())) {
+            if(this->_is_connected) {
 
                 if(!keepsending) {
-                    this->_messages_to_device_queue.push(std::vector<unsigned char> {
+                    this->_enqueMsgToDevice({
                     MSG_START_CONDITION,
                     MSG_LABEL_RECEIVE_DMX,
                     0x01, 0x00, 0x00,
@@ -81,140 +186,256 @@ class dmxusbpro_tilde : public object<dmxusbpro_tilde>, public vector_operator<>
                 // wait for message to be sent
                 std::this_thread::sleep_for(s_chrono::milliseconds(50));
 
-                this->_io_threads_continue = false;
+                Connector::get().reactor().remove(this);
 
-                if (Connector::get().closeSerialPort(this->_getOpenDeviceName()) != 0) {
+                if (Connector::get().closeSerialPort(this->_connection) != 0) {
                     cerr << "Error closing serial port." << endl;
                 }
 
+                this->_is_connected = false;
+                this->_connection.reset();
+
                 this->_connections[this->_open_device_name] = 0;
                 this->_open_device_name                     = "";
 
-                static_cast<void>(this->_messages_to_device_queue.empty());
+                if(verbose && this->_messages_to_device_queue.overflowCount() > 0) {
+                    cwarn << this->_messages_to_device_queue.overflowCount() << " messages to the device dropped: send queue full." << endl;
+                }
+
+                this->_latest_dmx_frame.clear();
+                this->_scheduled_dmx_frames.clear();
             }
 
 
-            atoms connection_state;
+            this->_enqueMaxEvent(TO_OUTLET_2, MaxEventType::CONNECTION_STATE, { 0 });
+        }
+
+        // Called from the I/O reactor thread when the connection broke. Closing is done on the Max thread.
+        void _deviceLost(const char *reason) {
+            if(this->_device_lost.exchange(true)) {
+                return;
+            }
+
+            this->_enqueMaxEvent(TO_MAX_CONSOLE_ERROR, MaxEventType::TEXT, {}, reason);
+            device_closer.delay(0);
+        }
 
-            connection_state.push_back(TO_OUTLET_2);
-            connection_state.push_back(0);
-            _enque_msg_to_max(connection_state);
-            deliverer_to_max.delay(0);
+        void onIoSend(int fd) override {
+            this->_sendPendingMessages(fd);
         }
 
-        void _sendThreadTask() {
-            atoms to_max;
+        void onIoReceive(int fd) override {
+            this->_receiveFromDevice(fd);
+        }
 
-            if(Connector::get().isConnected(this->_getOpenDeviceName())) {
-                // Test if the device is still connected
-                if (Connector::get().connectionState(this->_getOpenDeviceName()) != Connector::ConnectionState::OK) {
-                    return;
-                }
+        void onIoError(int fd, short poll_events) override {
+            this->_connection->setState(Connector::ConnectionState::MISSING);
+            this->_deviceLost("Device disconnected");
+        }
 
-                if(_messages_to_device_queue.size() > 0 ) {
-                    std::vector<unsigned char> msg_bytes = _messages_to_device_queue.front();
+        void onIoTick(int fd, s_chrono::steady_clock::time_point now) override {
+            if(this->_device_lost) {
+                return;
+            }
 
-                    _messages_to_device_queue.pop();
+            // Fallback: drop a response that isn't received completly within RESPONSE_TIMEOUT
+            if(this->_device_parser.expire(now, s_chrono::milliseconds(RESPONSE_TIMEOUT)) && verbose) {
+                this->_enqueMaxEvent(TO_MAX_CONSOLE_WARN, MaxEventType::TEXT, {}, "timeout receiving device response");
+            }
 
-                    std::size_t                msg_size = msg_bytes.size();
-                    char                       msg_buffer[msg_bytes.size()];
+            // Test if the device conntion is healthy. The termios check runs at the 'healthcheck' rate,
+            // unplugging is usually noticed earlier by poll() or a failing read() / write().
+            this->_handleConnectionState(this->_connection->monitor(now));
+        }
 
-                    for(std::size_t i = 0; i < msg_bytes.size(); i++) {
-                        msg_buffer[i] = msg_bytes[i];
-                    }
+        void _handleConnectionState(int connection_state) {
+            switch (connection_state) {
+                case Connector::ConnectionState::OK:
+                    break;
 
-                    std::size_t                success = write(Connector::get().getFd(this->_getOpenDeviceName()), msg_buffer, msg_size);
+                case Connector::ConnectionState::MISSING:
+                    this->_deviceLost("Device disconnected");
+                    break;
 
-                    if(success < 0) {
-                        to_max.clear();
-                        to_max.push_back(TO_OUTLET_DUMPOUT);
-                        to_max.push_back("Error writing bytes");
-                        _enque_msg_to_max(to_max);
-                        deliverer_to_max.delay(0);
-                    }
-                } else {
-                    std::this_thread::sleep_for(s_chrono::milliseconds(5));
-                }
+                default:
+                    this->_deviceLost("Device connection modified. Disconnecting");
+                    break;
             }
         }
 
-        void _receiveThreadTask() {
-            static std::vector<unsigned char> device_response;
-            static bool                       is_parsing_response      = false;
-            static int                        response_data_byte_count = 0;
-            static int                        respose_length           = 0;
-            static int                        response_index           = 0;
-            static s_chrono::time_point       response_paring_start    = s_chrono::steady_clock::now();
+        void _sendPendingMessages(int fd) {
+            device_message_t  *message;
+            const dmx_frame_t *dmx_frame;
 
+            this->_stats.recordSendQueueDepth(this->_messages_to_device_queue.size() + this->_scheduled_dmx_frames.size());
 
-            if(Connector::get().isConnected(this->_getOpenDeviceName())) {
-                // Test if the device conntion is healthy
-                int         connectionState = Connector::get().connectionState(this->_getOpenDeviceName());
+            // Nothing is written between a failed write and the close: the Max thread clears the queues
+            if(this->_device_lost || !this->_resumeWrite(fd)) {
+                return;
+            }
 
-                if ( connectionState != Connector::ConnectionState::OK) {
-                    switch (connectionState) {
-                        case Connector::ConnectionState::MISSING:
-                            cerr << "Device disconnected" << endl;
-                            break;
+            // Control messages keep their order and are sent before the latest DMX frame. In 'queue'
+            // mode DMX frames are queued with them and paced by the transmit queue as well.
+            while((message = _messages_to_device_queue.front()) != nullptr) {
+                if(message->bytes[1] == MSG_LABEL_SEND_DMX_PACKET && !this->_transmitQueueDrained(fd)) {
+                    return;
+                }
 
-                        default:
-                            cerr << "Device connection modified. Disconnecting" << endl;
-                            break;
-                    }
-                    this->_closeDevice();
-                    is_parsing_response      = false;
-                    response_data_byte_count = 0;
-                    respose_length           = 0;
-                    response_index           = 0;
+                bool is_written = _writeToDevice(fd, message->bytes, message->length, message->enqueued_at);
+
+                _messages_to_device_queue.pop();
+
+                if(!is_written) {
                     return;
                 }
+            }
 
-                // Getting response
-                memset(_serial_in_buffer, 0, SERIAL_IN_BUFF_SIZE);
+            // Until the transmit queue has drained, newer universes replace the frame in the slot
+            if(_latest_dmx_frame.pending() && this->_transmitQueueDrained(fd) && (dmx_frame = _latest_dmx_frame.take()) != nullptr) {
+                if(!_writeToDevice(fd, dmx_frame->data(), dmx_frame->size(), _latest_dmx_frame.storedAt())) {
+                    return;
+                }
+            }
 
-                std::size_t byte_count = read(Connector::get().getFd(this->_getOpenDeviceName()), _serial_in_buffer, SERIAL_IN_BUFF_SIZE);
+            this->_sendScheduledFrames(fd);
+        }
 
-                if(is_parsing_response) {
-                    // Fallback: timeout if response isn't received completly within 200ms
-                    auto elapsed_parsing_time =
-                        s_chrono::duration_cast<s_chrono::milliseconds>(s_chrono::steady_clock::now() - response_paring_start);
+        // Writes the timestamped frames that are due. In 'latest' mode frames released late, or while the
+        // transmit queue drains, are skipped in favour of the newest due frame.
+        void _sendScheduledFrames(int fd) {
+            scheduled_message_t                *scheduled_frame;
+            s_chrono::steady_clock::time_point now = s_chrono::steady_clock::now();
 
-                    if(elapsed_parsing_time.count() > RESPONSE_TIMEOUT) {
-                        is_parsing_response = false;
-                        response_index      = 0;
-                        cwarn << "timeout receiving device response" << endl;
+            while((scheduled_frame = this->_scheduled_dmx_frames.front()) != nullptr && scheduled_frame->release_at <= now) {
+                if(this->_send_latest.load(std::memory_order_relaxed)) {
+                    if(this->_has_due_dmx_frame) {
+                        this->_stats.frames_replaced.fetch_add(1, std::memory_order_relaxed);
                     }
+
+                    this->_due_dmx_frame.enqueued_at = scheduled_frame->enqueued_at;
+                    this->_due_dmx_frame.length      = scheduled_frame->length;
+                    memcpy(this->_due_dmx_frame.bytes, scheduled_frame->bytes, scheduled_frame->length);
+                    this->_has_due_dmx_frame = true;
+                    this->_scheduled_dmx_frames.pop();
+                    continue;
                 }
 
-                if (byte_count > 0) {
-                    if(_serial_in_buffer[0] == MSG_START_CONDITION && !is_parsing_response) {
-                        response_paring_start = s_chrono::steady_clock::now();
-                        is_parsing_response   = true;
-                        response_index        = 0;
-                        device_response.clear();
-                        is_parsing_response      = true;
-                        response_data_byte_count = (int)(((std::uint16_t)(_serial_in_buffer[3]) << 8) | (std::uint16_t)_serial_in_buffer[2]);
-                        respose_length           = response_data_byte_count + 5;
-                    }
+                if(!this->_transmitQueueDrained(fd)) {
+                    return;
+                }
 
-                    for (std::size_t i = 0; i < byte_count; i++) {
-                        device_response.push_back(_serial_in_buffer[i]);
-                        response_index++;
-                    }
+                bool is_written = _writeToDevice(fd, scheduled_frame->bytes, scheduled_frame->length, scheduled_frame->enqueued_at);
 
-                    if(response_index == respose_length) {
-                        atoms bytes_received;
+                this->_scheduled_dmx_frames.pop();
 
-                        is_parsing_response = false;
-                        response_index      = 0;
-                        _processDeviceResponds(device_response);
-                    }
+                if(!is_written) {
+                    return;
+                }
+            }
+
+            if(this->_has_due_dmx_frame && this->_transmitQueueDrained(fd)) {
+                this->_has_due_dmx_frame = false;
+                _writeToDevice(fd, this->_due_dmx_frame.bytes, this->_due_dmx_frame.length, this->_due_dmx_frame.enqueued_at);
+            }
+
+            if(scheduled_frame != nullptr) {
+                this->requestIoSendAt(scheduled_frame->release_at);
+            }
+        }
+
+        void _enqueMsgToDevice(std::initializer_list<unsigned char> msg_bytes) {
+            enqueDeviceMessage(this->_messages_to_device_queue, msg_bytes.begin(), msg_bytes.size());
+            this->requestIoSend();
+        }
+
+        // Returns false if the driver didn't take the whole message or the write failed. The rest is kept by
+        // _device_writer and written before any other message, onIoSend() is called again to do so.
+        bool _writeToDevice(int fd, const unsigned char *msg_bytes, std::size_t msg_size, s_chrono::steady_clock::time_point enqueued_at) {
+            s_chrono::steady_clock::time_point write_start = s_chrono::steady_clock::now();
+            std::size_t                        byte_count;
+            DeviceWriter::Result               result      = this->_device_writer.write(fd, msg_bytes, msg_size, byte_count);
+
+            this->_stats.write_duration.record(s_chrono::steady_clock::now() - write_start);
+
+            if(result != DeviceWriter::Result::FAILED && msg_bytes[1] == MSG_LABEL_SEND_DMX_PACKET) {
+                this->_stats.frames_sent.fetch_add(1, std::memory_order_relaxed);
+                this->_stats.enqueue_to_write.record(write_start - enqueued_at);
+            }
+
+            return this->_handleWriteResult(result, byte_count);
+        }
+
+        // Continues a message the driver didn't take completely. Returns false while it still isn't written or if the write failed.
+        bool _resumeWrite(int fd) {
+            std::size_t          byte_count;
+            DeviceWriter::Result result = this->_device_writer.resume(fd, byte_count);
+
+            return this->_handleWriteResult(result, byte_count);
+        }
+
+        bool _handleWriteResult(DeviceWriter::Result result, std::size_t byte_count) {
+            this->_stats.bytes_written.fetch_add((std::uint64_t)byte_count, std::memory_order_relaxed);
+
+            switch (result) {
+                case DeviceWriter::Result::COMPLETE:
+                    return true;
+
+                case DeviceWriter::Result::BLOCKED:
+                    this->_stats.write_stalls.fetch_add(1, std::memory_order_relaxed);
+                    this->requestIoSendAt(s_chrono::steady_clock::now() + s_chrono::milliseconds(TX_DRAIN_POLL_INTERVAL));
+                    return false;
+
+                case DeviceWriter::Result::FAILED:
+                    break;
+            }
+
+            this->_stats.write_errors.fetch_add(1, std::memory_order_relaxed);
+            this->_connection->reportIoError(this->_device_writer.errorNumber());
+
+            if(this->_connection->state() != Connector::ConnectionState::OK) {
+                this->_handleConnectionState(this->_connection->state());
+                return false;
+            }
+
+            // The message is dropped, the next ones are tried again later instead of in a burst of errors
+            this->_enqueMaxEvent(TO_OUTLET_DUMPOUT, MaxEventType::TEXT, {}, "Error writing bytes");
+            this->requestIoSendAt(s_chrono::steady_clock::now() + s_chrono::milliseconds(TX_DRAIN_POLL_INTERVAL));
+            return false;
+        }
+
+        // Frames are only written once the previous ones have left the driver's transmit queue, so they
+        // can't pile up there: in 'latest' mode the bytes on the wire always come from the newest universe,
+        // in 'queue' mode frames wait in order. Asks for onIoSend() to be called again while the queue drains.
+        bool _transmitQueueDrained(int fd) {
+            if(DeviceWriter::transmitQueued(fd) == 0) {
+                return true;
+            }
+
+            this->requestIoSendAt(s_chrono::steady_clock::now() + s_chrono::milliseconds(TX_DRAIN_POLL_INTERVAL));
+            return false;
+        }
+
+        void _receiveFromDevice(int fd) {
+            ssize_t byte_count = read(fd, _serial_in_buffer, SERIAL_IN_BUFF_SIZE);
+
+            if(byte_count <= 0) {
+                // poll() reported data, so nothing to read means the device is gone
+                if(byte_count == 0) {
+                    this->_connection->reportEndOfFile();
+                } else {
+                    this->_connection->reportIoError(errno);
                 }
+
+                this->_handleConnectionState(this->_connection->state());
+                return;
             }
+
+            this->_device_parser.parse(_serial_in_buffer, (std::size_t)byte_count, [this](const unsigned char *message, std::size_t length) {
+                this->_processDeviceResponds(message, length);
+            });
         }
 
-        void _processDeviceResponds(const std::vector<unsigned char> received_bytes) {
-            atoms response_message;
+        void _processDeviceResponds(const unsigned char *received_bytes, std::size_t length) {
             int   breaktime_val;
             int   mabtime_val;
             int   refresh_val;
@@ -223,83 +444,201 @@ class dmxusbpro_tilde : public object<dmxusbpro_tilde>, public vector_operator<>
 
             switch (received_bytes[1]) {
                 case MSG_LABEL_GET_WIDGET_PARAMETRES:
+                    // firmware version, break time, MAB time and refresh rate
+                    if(length < 10) {
+                        this->_enqueMaxEvent(TO_MAX_CONSOLE_ERROR, MaxEventType::TEXT, {}, "error parsing device response.");
+                        return;
+                    }
 
                     breaktime_val = (int)((float)received_bytes[6] * 10.67f);
                     mabtime_val   = (int)((float)received_bytes[7] * 10.67f);
                     refresh_val   = (int)received_bytes[8];
 
                     snprintf(firmware_version, 8, "%d.%d", received_bytes[5], received_bytes[4] );
-                    response_message.push_back(TO_OUTLET_DUMPOUT);
-                    response_message.push_back("firmware");
-                    response_message.push_back(std::string(firmware_version));
-                    _enque_msg_to_max(response_message);
-                    deliverer_to_max.delay(0);
-
-                    response_message.clear();
-                    response_message.push_back(TO_OUTLET_DUMPOUT);
-                    response_message.push_back("breaktime");
-                    response_message.push_back(breaktime_val);
-                    _enque_msg_to_max(response_message);
-                    deliverer_to_max.delay(0);
-
-                    response_message.clear();
-                    response_message.push_back(TO_OUTLET_DUMPOUT);
-                    response_message.push_back("mabtime");
-                    response_message.push_back(mabtime_val);
-                    _enque_msg_to_max(response_message);
-                    deliverer_to_max.delay(0);
-
-                    response_message.clear();
-                    response_message.push_back(TO_OUTLET_DUMPOUT);
-                    response_message.push_back("refresh");
-                    response_message.push_back(refresh_val);
-                    _enque_msg_to_max(response_message);
-                    deliverer_to_max.delay(0);
+                    this->_enqueMaxEvent(TO_OUTLET_DUMPOUT, MaxEventType::DEVICE_SETTINGS, { breaktime_val, mabtime_val, refresh_val }, firmware_version);
                     return;
 
                 case MSG_LABEL_GET_WIDGET_SERIAL_NUMBER:
+                    if(length < 9) {
+                        this->_enqueMaxEvent(TO_MAX_CONSOLE_ERROR, MaxEventType::TEXT, {}, "error parsing device response.");
+                        return;
+                    }
+
                     snprintf(serial_number_string,10,"%02X%02X%02X%02X",
                              received_bytes[7], received_bytes[6],
                              received_bytes[5], received_bytes[4]
                              );
-                    response_message.push_back(TO_OUTLET_DUMPOUT);
-                    response_message.push_back("serialnumber");
-                    response_message.push_back(serial_number_string);
-                    _enque_msg_to_max(response_message);
-                    deliverer_to_max.delay(0);
+                    this->_enqueMaxEvent(TO_OUTLET_DUMPOUT, MaxEventType::SERIAL_NUMBER, {}, serial_number_string);
                     return;
 
                 default:
-                    cerr << "error parsing device response." << endl;
+                    this->_enqueMaxEvent(TO_MAX_CONSOLE_ERROR, MaxEventType::TEXT, {}, "error parsing device response.");
                     return;
             }
         }
 
-        void _enqueMsgSendDmxPpacket(const unsigned char (&universe)[512]) {
-            std::uint16_t              channel_count       = 512;
-            std::uint16_t              data_byte_count     = channel_count + 1;
-            unsigned char              data_byte_count_lsb = (unsigned char)(data_byte_count & 0x00FF);
-            unsigned char              data_byte_count_msb = (unsigned char)((data_byte_count & 0xFF00) >> 8);
+        // Channels to send: the 'channels' attribute or, if it is 0, the highest channel used so far
+        std::size_t _frameChannelCount() {
+            int channel_count = this->_channel_count_setting.load(std::memory_order_relaxed);
 
-            std::vector<unsigned char> msg_send_dmx {
-                MSG_START_CONDITION,
-                MSG_LABEL_SEND_DMX_PACKET,
-                data_byte_count_lsb, data_byte_count_msb,
-                0x00 // Start Code: USITT Default Null Start Code for Dimmers per DMX512 & DMX512/1990
-            };
+            return (std::size_t)(channel_count > 0 ? channel_count : this->_highest_channel.load(std::memory_order_relaxed));
+        }
+
+        // Called from the audio thread: neither allocates, locks nor makes syscalls. The reactor isn't woken,
+        // it picks the frame up within AUDIO_IO_POLL_INTERVAL.
+        // With a 'latency' the frame is written at 'push_time' + latency, otherwise as soon as possible.
+        // The scheduled frames are released in the order they were pushed, so after the latency was lowered
+        // a frame is held back until the frames pushed before it are due.
+        void _enqueMsgSendDmxPpacket(const unsigned char (&universe)[512], s_chrono::steady_clock::time_point push_time) {
+            std::size_t channel_count = this->_frameChannelCount();
+            int         latency       = this->_latency.load(std::memory_order_relaxed);
+
+            if(latency > 0) {
+                s_chrono::steady_clock::time_point release_at = std::max(push_time + s_chrono::milliseconds(latency), this->_last_release_at);
+
+                if(this->_scheduled_dmx_frames.tryPush([&universe, channel_count, push_time, release_at](scheduled_message_t &message) {
+                    message.enqueued_at = push_time;
+                    message.release_at  = release_at;
+                    message.length      = (std::uint16_t)dmx_frame_t::encode(message.bytes, universe, channel_count);
+                })) {
+                    this->_last_release_at = release_at;
+                    this->requestIoSendAt(release_at, false);
+                } else {
+                    this->_stats.frames_overflowed.fetch_add(1, std::memory_order_relaxed);
+                }
+
+                return;
+            }
+
+            if(this->_send_latest.load(std::memory_order_relaxed)) {
+                if(this->_latest_dmx_frame.store(universe, channel_count, push_time)) {
+                    this->_stats.frames_replaced.fetch_add(1, std::memory_order_relaxed);
+                }
+            } else if(!this->_messages_to_device_queue.tryPush([&universe, channel_count, push_time](device_message_t &message) {
+                message.enqueued_at = push_time;
+                message.length      = (std::uint16_t)dmx_frame_t::encode(message.bytes, universe, channel_count);
+            })) {
+                this->_stats.frames_overflowed.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            this->requestIoSend(false);
+        }
+
+        // Reducer of the multichannel inlet's channel 'mc_channel' and of the argument inlet 'inlet_index'
+        SignalReducer& _mcReducer(std::size_t mc_channel) {
+            return this->_reducers[1 + mc_channel];
+        }
+
+        SignalReducer& _inletReducer(std::size_t inlet_index) {
+            return this->_reducers[1 + 512 + inlet_index];
+        }
+
+        // Channels of the multichannel inlet that control a DMX channel
+        std::size_t _mcUsedChannelCount(std::size_t mc_channel_count) {
+            int mc_address = this->_mc_address.load(std::memory_order_relaxed);
+
+            return mc_address == 0 ? 0 : std::min<std::size_t>(mc_channel_count, 512 - (mc_address - 1));
+        }
+
+        // Finds the first channel of every signal inlet in 'input', which holds the channels of the master,
+        // the argument inlets and the multichannel inlet in this order. Only the first channel of a multichannel
+        // signal in the master or an argument inlet is used. Returns the channel count of the multichannel inlet.
+        std::size_t _mapInputChannels(const audio_bundle &input) {
+            std::size_t signal_inlet_count = this->_inlet_first_channels.size();
+            std::size_t first_channel      = 0;
+
+            for(std::size_t i = 0; i < signal_inlet_count; i++) {
+                this->_inlet_first_channels[i] = first_channel;
+                first_channel                 += (std::size_t)std::max(1, this->_inlet_channel_counts[i].load(std::memory_order_relaxed));
+            }
+
+            if(first_channel == input.channel_count()) {
+                return (std::size_t)std::max(1, this->_inlet_channel_counts[signal_inlet_count - 1].load(std::memory_order_relaxed));
+            }
+
+            // Counts not reported by Max: one channel per single signal inlet, the rest belongs to the multichannel inlet
+            for(std::size_t i = 0; i < signal_inlet_count; i++) {
+                this->_inlet_first_channels[i] = i;
+            }
+
+            return input.channel_count() > signal_inlet_count - 1 ? input.channel_count() - (signal_inlet_count - 1) : 0;
+        }
+
+        // Max calls 'inputchanged' on the main thread when the number of channels connected to an inlet changes
+        static long _inputChanged(minwrapper<dmxusbpro_tilde> *self, long inlet_index, long channel_count) {
+            self->m_min_object._setInletChannelCount(inlet_index, channel_count);
+            return false; // the outlets don't depend on it
+        }
+
+        void _setInletChannelCount(long inlet_index, long channel_count) {
+            if(inlet_index < 0 || (std::size_t)inlet_index >= this->_inlet_channel_counts.size()) {
+                return;
+            }
+
+            if(channel_count > 1 && (std::size_t)inlet_index + 1 < this->_inlet_channel_counts.size()) {
+                cwarn << "inlet " << inlet_index + 1 << " uses the first of the " << channel_count << " channels connected, use the last inlet for multichannel signals." << endl;
+            }
 
-            for(std::uint16_t i = 0; i < channel_count; i++) {
-                msg_send_dmx.push_back(universe[i]);
+            this->_inlet_channel_counts[inlet_index].store((int)channel_count, std::memory_order_relaxed);
+        }
+
+        // Feeds 'frame_count' samples of the signal vector from 'start' on to the reducers, so the value pushed
+        // reflects every sample since the previous push
+        void _accumulate(audio_bundle &input, std::size_t mc_channel_count, ReduceMode mode, std::size_t start, std::size_t frame_count) {
+            std::size_t mc_used_channels = this->_mcUsedChannelCount(mc_channel_count);
+            std::size_t mc_first_channel = this->_inlet_first_channels.back();
+
+            if(mode != this->_reduced_mode) {
+                for(SignalReducer &reducer : this->_reducers) {
+                    reducer.reset();
+                }
+
+                this->_reduced_mode = mode;
+            }
+
+            if(input.channel_count() == 0 || frame_count == 0) {
+                return;
+            }
+
+            this->_reducers[0].accumulate(input.samples(0) + start, frame_count, mode);
+
+            for(std::size_t inlet_index = 0; inlet_index < _inlets.size(); inlet_index++) {
+                std::size_t channel = this->_inlet_first_channels[1 + inlet_index];
+
+                if(channel < input.channel_count()) {
+                    this->_inletReducer(inlet_index).accumulate(input.samples(channel) + start, frame_count, mode);
+                }
+            }
+
+            for(std::size_t i = 0; i < mc_used_channels; i++) {
+                this->_mcReducer(i).accumulate(input.samples(mc_first_channel + i) + start, frame_count, mode);
+            }
+        }
+
+        // Converts the reduced multichannel inlet to the DMX channels from 'mcaddress' on in one vectorised pass.
+        // Returns true if a channel has changed.
+        bool _mcToUniverse(std::size_t mc_channel_count, double master, ReduceMode mode) {
+            int         mc_address    = this->_mc_address.load(std::memory_order_relaxed);
+            std::size_t channel_count = this->_mcUsedChannelCount(mc_channel_count);
+
+            if(channel_count == 0 || !UniverseUpdate::fromReducers(&this->_mcReducer(0), channel_count, mode, (float)(master * 255.), this->_dmx_universe + mc_address - 1)) {
+                return false;
             }
 
-            msg_send_dmx.push_back(MSG_END_CONDITION);
-            this->_messages_to_device_queue.push(msg_send_dmx);
+            int highest_channel = mc_address - 1 + (int)channel_count;
+
+            if(highest_channel > this->_highest_channel.load(std::memory_order_relaxed)) {
+                this->_highest_channel.store(highest_channel, std::memory_order_relaxed);
+            }
+
+            return true;
         }
 
     public:
 
         dmxusbpro_tilde(const atoms& args = {}) {
             memset(this->_dmx_universe, 0, 512);
+            this->setIoPollInterval(s_chrono::milliseconds(AUDIO_IO_POLL_INTERVAL));
 
             if (!args.empty()) {
 
@@ -324,8 +663,19 @@ class dmxusbpro_tilde : public object<dmxusbpro_tilde>, public vector_operator<>
 
                     _inlets.push_back(std::move(dmx_inlet));
                     _inlet_dmx_channel.push_back(dmx_channel);
+                    _inlet_dmx_value.push_back(-1);
+                    this->_highest_channel = std::max(this->_highest_channel.load(), dmx_channel);
                 }
             }
+
+            this->_mc_inlet = std::make_unique<inlet<> >(this, "(multichannelsignal) DMX channels from 'mcaddress' on", "multichannelsignal");
+            this->_reducers.resize(1 + 512 + _inlets.size());
+            this->_inlet_first_channels.resize(2 + _inlets.size());
+            this->_inlet_channel_counts = std::vector<std::atomic<int> >(2 + _inlets.size());
+
+            for(std::atomic<int> &channel_count : this->_inlet_channel_counts) {
+                channel_count.store(1, std::memory_order_relaxed);
+            }
         }
 
         ~dmxusbpro_tilde() {
@@ -346,44 +696,25 @@ class dmxusbpro_tilde : public object<dmxusbpro_tilde>, public vector_operator<>
         outlet<> output_3   { this, "(anything) Connect to umenu" };
         outlet<> output_dumpout   { this, "dumpout", "anything"};
 
-        timer<> deliverer_to_max {
+        timer<timer_options::defer_delivery> device_closer {
             this, MIN_FUNCTION {
-                atoms queue_data;
-
-                while (_dequeue_msg_to_max(queue_data)) {
-                    int   destination = queue_data[0];
-                    atoms message;
-
-                    for(std::size_t i = 1; i < queue_data.size(); i++) {
-                        message.push_back(queue_data[i]);
-                    }
-
-                    switch (destination) {
-                        case TO_OUTLET_1:
-                            output_1.send(message);
-                            break;
-
-                        case TO_OUTLET_2:
-                            output_2.send(message);
-                            break;
-
-                        case TO_OUTLET_3:
-                            output_3.send(message);
-                            break;
-
-                        case TO_OUTLET_DUMPOUT:
-                            output_dumpout.send(message);
-                            break;
+                this->_closeDevice();
+                return {};
+            }
+        };
 
-                        case TO_MAX_CONSOLE:
+        timer<> deliverer_to_max {
+            this, MIN_FUNCTION {
+                max_event_t *event;
 
-                            for(std::size_t i = 0; i < message.size(); i++) {
-                                cout << message[i] << endl;
-                            }
+                // Cleared first, so events queued from now on schedule another delivery
+                this->_delivery_scheduled.store(false, std::memory_order_release);
 
-                            break;
-                    }
+                while ((event = this->_max_events.front()) != nullptr) {
+                    this->_deliverMaxEvent(*event);
+                    this->_max_events.pop();
                 }
+
                 return {};
             }
         };
@@ -395,7 +726,7 @@ class dmxusbpro_tilde : public object<dmxusbpro_tilde>, public vector_operator<>
             range {9600, 256000},
             readonly {false},
             setter { MIN_FUNCTION {
-                         if(Connector::get().isConnected(this->_getOpenDeviceName())) {
+                         if(this->_is_connected) {
                              cerr << "baudrate has changed. closing the connection." << endl;
                              this->_closeDevice();
                          }
@@ -405,19 +736,114 @@ class dmxusbpro_tilde : public object<dmxusbpro_tilde>, public vector_operator<>
             }
         };
 
+        attribute<int, threadsafe::no, limit::clamp, allow_repetitions::no> healthcheck {
+            this, "healthcheck", HEALTH_CHECK_INTERVAL,
+            title { "Health check interval" },
+            description { "Interval in ms at which the settings of the serial connection are checked for modifications by other applications. Default: 1000. 0 disables the check.<br />Unplugging the device is detected independently of this interval." },
+            range { 0, 60000 },
+            setter { MIN_FUNCTION {
+                         if(this->_connection) {
+                             this->_connection->setHealthCheckInterval(args[0]);
+                         }
+
+                         return args;
+                     }
+            }
+        };
+
         attribute<bool, threadsafe::no, limit::none, allow_repetitions::no> keepsending {
             this, "keepsending", false,
             title { "Keep sending" },
             description { "If set to 0 (default), the device will stop sending DMX data when the connection is closed.<br />If set to 1 the device will continue to send the last received DMX data after the connection has been closed." }
         };
 
+        attribute<symbol, threadsafe::no, limit::none, allow_repetitions::no> sendmode {
+            this, "sendmode", "latest",
+            title { "DMX send mode" },
+            description { "If set to 'latest' (default) DMX frames that have not been written to the device yet are replaced by newer ones, so the device always receives the latest universe. If set to 'queue' every DMX frame is written to the device in order." },
+            range {"latest", "queue"},
+            setter { MIN_FUNCTION {
+                         symbol send_mode = args[0];
+
+                         this->_send_latest = send_mode == "latest";
+                         return args;
+                     }
+            }
+        };
+
+        attribute<int, threadsafe::no, limit::clamp, allow_repetitions::no> channels {
+            this, "channels", 512,
+            title { "DMX channel count" },
+            description { "Number of DMX channels sent to the device, 512 by default. A DMX frame takes about 44 microseconds per channel on the wire, so sending only the channels in use raises the refresh rate of the DMX output. If set to 0 frames end at the highest channel with an inlet so far. Frames carry at least 24 channels." },
+            range {0, 512},
+            setter { MIN_FUNCTION {
+                         this->_channel_count_setting = std::min(512, std::max(0, (int)args[0]));
+                         return args;
+                     }
+            }
+        };
+
         attribute<int, threadsafe::yes, limit::clamp, allow_repetitions::no> push {
             this,
             "push",
             20,
             title { "Push Intermal (ms)" },
             description { "Minimum interval to push DMX value changes to the device in ms."},
-            range { 10, 10000 }
+            range { 10, 10000 },
+            setter { MIN_FUNCTION {
+                         this->_push_interval = std::min(10000, std::max(10, (int)args[0]));
+                         return args;
+                     }
+            }
+        };
+
+        attribute<int, threadsafe::no, limit::clamp, allow_repetitions::no> latency {
+            this, "latency", 0,
+            title { "Latency (ms)" },
+            description { "If greater than 0, DMX frames are stamped with the sample they were pushed at and written to the device <i>latency</i> ms later, evenly spaced on the audio timeline instead of following the timing of the signal vectors. Use at least the duration of the audio I/O vector. Frames keep their order: after lowering the latency, new frames wait for the ones pushed before them. 0 (default) writes frames as soon as they are computed." },
+            range { 0, 1000 },
+            setter { MIN_FUNCTION {
+                         this->_latency = std::min(1000, std::max(0, (int)args[0]));
+                         return args;
+                     }
+            }
+        };
+
+        attribute<int, threadsafe::no, limit::clamp, allow_repetitions::no> mcaddress {
+            this, "mcaddress", 0,
+            title { "MC start address" },
+            description { "DMX channel controlled by the first channel of the multichannel signal in the last inlet. Channel n of the signal controls DMX channel <i>mcaddress</i> + n - 1, channels beyond 512 are ignored. 0 (default) ignores the multichannel inlet.<br />Inlets created with arguments take precedence over the multichannel inlet." },
+            range { 0, 512 },
+            setter { MIN_FUNCTION {
+                         this->_mc_address = std::min(512, std::max(0, (int)args[0]));
+                         return args;
+                     }
+            }
+        };
+
+        attribute<symbol, threadsafe::no, limit::none, allow_repetitions::no> reduce {
+            this, "reduce", "last",
+            title { "Signal reduction" },
+            description { "How the samples of a push interval are reduced to one DMX value per channel. 'first': the first sample. 'last' (default): the latest sample. 'mean': the average. 'peak': the maximum, so short peaks aren't lost. 'rms': the root mean square, following the signal's energy." },
+            range { "first", "last", "mean", "peak", "rms" },
+            setter { MIN_FUNCTION {
+                         symbol reduce_mode = args[0];
+
+                         if(reduce_mode == "first") {
+                             this->_reduce_mode = ReduceMode::FIRST;
+                         } else if(reduce_mode == "mean") {
+                             this->_reduce_mode = ReduceMode::MEAN;
+                         } else if(reduce_mode == "peak") {
+                             this->_reduce_mode = ReduceMode::PEAK;
+                         } else if(reduce_mode == "rms") {
+                             this->_reduce_mode = ReduceMode::RMS;
+                         } else {
+                             this->_reduce_mode = ReduceMode::LAST;
+                         }
+
+                         return args;
+                     }
+            }
         };
 
         attribute<bool, threadsafe::no, limit::none, allow_repetitions::no> verbose {
@@ -428,6 +854,18 @@ class dmxusbpro_tilde : public object<dmxusbpro_tilde>, public vector_operator<>
             description { "If set to 0 (default), only serial devices following the ENTTEC USB DMX Pro naming convention will be enabled in a umenu connected to the third outlet. <br /> If set to 1 all serial devices will be enabled and more information about the coinnection state will be printed to the Max console." }
         };
 
+        // Registers 'inputchanged', so the channels of every inlet are known and a multichannel signal
+        // in the master or an argument inlet doesn't shift the channels of the inlets after it
+        message<> maxclass_setup {
+            this, "maxclass_setup",
+            MIN_FUNCTION {
+                c74::max::t_class *c = args[0];
+
+                c74::max::class_addmethod(c, (c74::max::method)_inputChanged, "inputchanged", c74::max::A_CANT, 0);
+                return {};
+            }
+        };
+
         message<threadsafe::yes> open {
             this, "open", "Open serial connection to a device. <p>Argument: portname[symbol]</p>",
             MIN_FUNCTION {
@@ -468,81 +906,35 @@ class dmxusbpro_tilde : public object<dmxusbpro_tilde>, public vector_operator<>
 
                 this->_closeDevice();
 
-                int         set_baudrate = baudrate;
-                int         open_success = Connector::get().openSerialPort(device_name, set_baudrate);
-
-                if(open_success == -1) {
-                    cerr << "Error opening device" << endl;
+                if(Connector::get().isConnected(device_name)) {
+                    cerr << "'" << device_name << "' already opened by another instance." << endl;
                     return {};
                 }
 
-                if(open_success == -2) {
-                    cerr << "'" << device_name << "' already opened by another instance." << endl;
+                int                     set_baudrate = baudrate;
+                Connector::connection_t connection   = Connector::get().openSerialPort(device_name, set_baudrate);
+
+                if(!connection) {
+                    cerr << "Error opening device" << endl;
                     return {};
                 }
 
                 this->_setOpenDeviceName(device_name);
                 this->_connections[symbol(device_name)] = 1;
-                atoms       connection_state;
-                connection_state.push_back(TO_OUTLET_2);
-                connection_state.push_back(1);
-                _enque_msg_to_max(connection_state);
-                deliverer_to_max.delay(0);
-
-                this->_io_threads_continue = true;
-                std::this_thread::sleep_for(s_chrono::milliseconds(10));
-
-                this->_receive_thread = std::thread([this]()
-            {
-                atoms msg_to_console;
-
-                if (verbose) {
-                    msg_to_console.push_back(TO_MAX_CONSOLE);
-                    msg_to_console.push_back("starting receive thread");
-                    _enque_msg_to_max(msg_to_console);
-                    deliverer_to_max.delay(0);
-                }
-
-                while(_io_threads_continue) {
-                    _receiveThreadTask();
-                }
-
-                if (verbose) {
-                    msg_to_console.clear();
-                    msg_to_console.push_back(TO_MAX_CONSOLE);
-                    msg_to_console.push_back("stopping receive thread");
-                    _enque_msg_to_max(msg_to_console);
-                    deliverer_to_max.delay(0);
-                }
-            });
-                this->_receive_thread.detach();
-
-                this->_send_thread = std::thread([this]()
-            {
-                atoms msg_to_console;
-
-                if (verbose) {
-                    msg_to_console.push_back(TO_MAX_CONSOLE);
-                    msg_to_console.push_back("starting send thread");
-                    _enque_msg_to_max(msg_to_console);
-                    deliverer_to_max.delay(0);
-                }
-
-                while(_io_threads_continue) {
-                    _sendThreadTask();
-                }
-
-                if (verbose) {
-                    if (verbose) {
-                        msg_to_console.clear();
-                        msg_to_console.push_back(TO_MAX_CONSOLE);
-                        msg_to_console.push_back("stopping send thread");
-                        _enque_msg_to_max(msg_to_console);
-                        deliverer_to_max.delay(0);
-                    }
-                }
-            });
-                this->_send_thread.detach();
+                this->_enqueMaxEvent(TO_OUTLET_2, MaxEventType::CONNECTION_STATE, { 1 });
+
+                // Messages left from a previous connection must not be sent to this device
+                this->_messages_to_device_queue.clear();
+                this->_latest_dmx_frame.clear();
+                this->_scheduled_dmx_frames.clear();
+                this->_device_parser.reset();
+                this->_device_writer.clear();
+                this->_has_due_dmx_frame = false;
+                this->_device_lost  = false;
+                this->_connection   = connection;
+                this->_connection->setHealthCheckInterval(healthcheck);
+                this->_is_connected = true;
+                Connector::get().reactor().add(this, connection->fd());
                 return {};
             }
         };
@@ -562,7 +954,7 @@ class dmxusbpro_tilde : public object<dmxusbpro_tilde>, public vector_operator<>
                 out_atoms.push_back("(Select Interface)");
                 output_3.send(out_atoms);
 
-                std::vector<std::string> device_names = Connector::get().getDeviceNames(verbose, true);
+                std::vector<std::string> device_names = Connector::get().getDeviceNames(verbose);
 
                 for (auto& device_name : device_names) {
                     atoms device_list;
@@ -583,7 +975,7 @@ class dmxusbpro_tilde : public object<dmxusbpro_tilde>, public vector_operator<>
                     cwarn << "extra argument for message 'getparams'" << endl;
                 }
 
-                if(!Connector::get().isConnected(this->_getOpenDeviceName())) {
+                if(!this->_is_connected) {
                     if(verbose) {
                         cerr << "Can't get DMX parameters, not connected." << endl;
                     }
@@ -591,7 +983,7 @@ class dmxusbpro_tilde : public object<dmxusbpro_tilde>, public vector_operator<>
                     return {};
                 }
 
-                this->_messages_to_device_queue.push(std::vector<unsigned char> {
+                this->_enqueMsgToDevice({
                 MSG_START_CONDITION,
                 MSG_LABEL_GET_WIDGET_PARAMETRES,
                 0x00, 0x00,
@@ -609,7 +1001,7 @@ class dmxusbpro_tilde : public object<dmxusbpro_tilde>, public vector_operator<>
                     cwarn << "extra argument for message 'getserial'" << endl;
                 }
 
-                if(!Connector::get().isConnected(this->_getOpenDeviceName())) {
+                if(!this->_is_connected) {
                     if(verbose) {
                         cerr << "Can't get serial number, not connected." << endl;
                     }
@@ -617,7 +1009,7 @@ class dmxusbpro_tilde : public object<dmxusbpro_tilde>, public vector_operator<>
                     return {};
                 }
 
-                this->_messages_to_device_queue.push(std::vector<unsigned char> {
+                this->_enqueMsgToDevice({
                 MSG_START_CONDITION,
                 MSG_LABEL_GET_WIDGET_SERIAL_NUMBER,
                 0x00, 0x00,
@@ -626,6 +1018,23 @@ class dmxusbpro_tilde : public object<dmxusbpro_tilde>, public vector_operator<>
             }
         };
 
+        message<threadsafe::no> stats {
+            this, "stats", "Send statistics of the DMX pipeline out the dumpout outlet: frames sent (total, per second since the last 'stats'), bytes written, write errors, writes the driver didn't take at once, enqueue to write latency and write() duration (count, mean, median, 99th percentile, maximum in microseconds), send queue depth (current, maximum), dropped frames (replaced by newer ones, send queue full), events to Max dropped and parser resyncs, timeouts and skipped bytes.",
+            MIN_FUNCTION {
+                output_dumpout.send("framessent", (long)this->_stats.frames_sent.load(), this->_stats.sendRate());
+                output_dumpout.send("byteswritten", (long)this->_stats.bytes_written.load());
+                output_dumpout.send("writeerrors", (long)this->_stats.write_errors.load());
+                output_dumpout.send("writestalls", (long)this->_stats.write_stalls.load());
+                this->_sendHistogram("latency", this->_stats.enqueue_to_write.summary());
+                this->_sendHistogram("writetime", this->_stats.write_duration.summary());
+                output_dumpout.send("queuedepth", (long)(this->_messages_to_device_queue.size() + this->_scheduled_dmx_frames.size()), (long)this->_stats.send_queue_depth_max.load());
+                output_dumpout.send("framesdropped", (long)this->_stats.frames_replaced.load(), (long)this->_stats.frames_overflowed.load());
+                output_dumpout.send("eventsdropped", (long)this->_max_events.overflowCount());
+                output_dumpout.send("parser", (long)this->_device_parser.resyncCount(), (long)this->_device_parser.timeoutCount(), (long)this->_device_parser.skippedBytes());
+                return {};
+            }
+        };
+
         message<threadsafe::yes> close {
             this, "close", "Close the device connection. If <i>keepsending</i> is 0: Stop sending DMX data.",
             MIN_FUNCTION {
@@ -639,38 +1048,65 @@ class dmxusbpro_tilde : public object<dmxusbpro_tilde>, public vector_operator<>
             }
         };
 
+        // Channels of the signal inlets in 'input': the master (one channel), one channel per inlet
+        // created with arguments and the multichannel inlet.
         void operator ()(audio_bundle input, audio_bundle output) {
-            static auto                         last_run = s_chrono::steady_clock::now();
-            static std::map<int, unsigned char> prev_dmx_vals;
-            std::map<int, unsigned char>        current_dmx_vals;
-            auto                                now           = s_chrono::steady_clock::now();
-            auto                                elaped        = s_chrono::duration_cast<s_chrono::milliseconds>(now - last_run);
-            int                                 push_interval = push;
+            std::size_t frame_count      = input.frame_count();
+            std::size_t mc_channel_count = this->_mapInputChannels(input);
+            ReduceMode  mode             = this->_reduce_mode.load(std::memory_order_relaxed);
+
+            // Nothing to send to: skip reducing and pushing. The push grid starts over with the next connection.
+            if(!this->_is_connected.load(std::memory_order_relaxed)) {
+                if(this->_is_pushing) {
+                    for(SignalReducer &reducer : this->_reducers) {
+                        reducer.reset();
+                    }
 
-            if(elaped.count() >= push_interval) {
-                last_run = s_chrono::steady_clock::now();
+                    this->_samples_until_push = 0;
+                    this->_is_pushing         = false;
+                }
 
-                auto   in_master = input.samples(0);
-                double master    = std::min(1., std::max(0., in_master[0]));
+                return;
+            }
 
-                for (std::size_t inlet_index = 0; inlet_index < _inlets.size(); inlet_index++) {
-                    auto          in             = input.samples(inlet_index + 1); // first inlet is the master concrol
-                    double        channel_sample = std::min(1., std::max(0., in[0]));
-                    unsigned char dmx_value      = round(channel_sample * master * 255.);
+            this->_is_pushing = true;
+            this->_sample_clock.startVector(s_chrono::steady_clock::now(), samplerate(), frame_count);
 
-                    current_dmx_vals.emplace(this->_inlet_dmx_channel[inlet_index], dmx_value);
-                }
+            // The push interval is counted in samples of this instance's signal vectors.
+            // The push happens at sample 'push_offset' of this vector and the next one is counted from there,
+            // so pushes stay on a regular grid whatever the vector size.
+            if(this->_samples_until_push >= frame_count) {
+                this->_samples_until_push -= frame_count;
+                this->_accumulate(input, mc_channel_count, mode, 0, frame_count);
+                return;
+            }
 
-                if(current_dmx_vals != prev_dmx_vals) {
-                    auto it = current_dmx_vals.begin();
+            std::size_t push_offset  = this->_samples_until_push;
+            std::size_t samples_left = frame_count - push_offset;
+            std::size_t interval     = std::max<std::size_t>(1, (std::size_t)std::lround(this->_push_interval.load(std::memory_order_relaxed) * samplerate() / 1000.));
 
-                    while (it != current_dmx_vals.end()) {
-                        this->_dmx_universe[it->first - 1] = it->second;
-                        it++;
-                    }
-                    prev_dmx_vals = current_dmx_vals;
-                    this->_enqueMsgSendDmxPpacket(this->_dmx_universe);
-                }
+            this->_samples_until_push = (interval - samples_left % interval) % interval;
+
+            // The pushed value reduces the samples up to and including the one at 'push_offset',
+            // the rest of the vector belongs to the next push
+            this->_accumulate(input, mc_channel_count, mode, 0, push_offset + 1);
+
+            double master      = std::min(1., std::max(0., this->_reducers[0].value(mode)));
+            bool   has_changed = this->_mcToUniverse(mc_channel_count, master, mode);
+
+            if(!_inlets.empty() && UniverseUpdate::fromInletReducers(&this->_inletReducer(0), _inlets.size(), mode, master,
+                                                                     this->_inlet_dmx_channel.data(), this->_inlet_dmx_value.data(), this->_dmx_universe)) {
+                has_changed = true;
+            }
+
+            for(SignalReducer &reducer : this->_reducers) {
+                reducer.reset();
+            }
+
+            this->_accumulate(input, mc_channel_count, mode, push_offset + 1, samples_left - 1);
+
+            if(has_changed) {
+                this->_enqueMsgSendDmxPpacket(this->_dmx_universe, this->_sample_clock.timeOf(push_offset));
             }
         }
 };